@@ -0,0 +1,93 @@
+#include "pg_anonymous/Rules.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Measures per-row evaluation cost of compiled templates.
+ * Built twice by bench/CMakeLists.txt: once with std::visit dispatch and once with
+ * PG_ANONYMOUS_VIRTUAL_DISPATCH, so the two binaries can be compared side by side.
+ */
+int main(int argc, char *argv[])
+{
+    const size_t row_count = argc > 1 ? std::stoul(argv[1]) : 1000000;
+
+    const std::map<std::string, std::vector<std::string>> catalog{{"names", {"Alice", "Bob", "Carol", "Dave"}}};
+    const std::vector<std::pair<std::string, std::string>> templates{
+        {"leaves", "user-{{hash(s)}}-{{literal(x)}}-{{none}}"},
+        {"conditional", "{{if({{none}}, eq, active, A, {{if({{none}}, neq, blocked, B, C)}})}}"},
+        {"catalog", "{{pick_from_catalog(names, {{hash(id)}})}}"},
+        {"match_group", "{{hash(e)}}@{{match_group(email, ^([^@]+)@(.+)$, 2)}}"},
+    };
+
+    const std::vector<std::string> columns{"id", "email", "status"};
+    const std::vector<std::string> statuses{"active", "blocked", "pending"};
+    std::vector<std::vector<std::string>> rows;
+    for (size_t i = 0; i < 1024; ++i)
+        rows.push_back({std::to_string(i), "user" + std::to_string(i) + "@example.com", statuses[i % 3]});
+
+#ifdef PG_ANONYMOUS_VIRTUAL_DISPATCH
+    std::cout << "dispatch: virtual\n";
+#else
+    std::cout << "dispatch: variant\n";
+#endif
+
+    for (const auto &[label, raw_template] : templates)
+    {
+        RowSlots slots;
+        RuleEnvironment env(1);
+        auto rule = RuleFactory::compile_template(raw_template, catalog, slots, env);
+        const RuleRef root = rule->as_ref();
+        const std::vector<size_t> slot_indices = slots.bind(columns, "bench");
+        ExecutionContext execution(env.layout);
+
+        std::vector<std::string_view> row_values(columns.size());
+        RowCache row_cache;
+        size_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < row_count; ++n)
+        {
+            const auto &row = rows[n % rows.size()];
+            for (size_t c = 0; c < row.size(); ++c)
+                row_values[c] = row[c];
+            row_cache.next_row();
+            RowContext ctx{slots, slot_indices, row_values, row_cache, execution};
+            checksum += apply_rule(root, row[2], ctx).size();
+        }
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << label << ": " << elapsed / row_count << " ns/row (checksum " << checksum << ")\n";
+
+        // The same rows evaluated a column batch at a time, as BatchExecutor does.
+        std::vector<std::string_view> batch_values(rows.size() * columns.size());
+        for (size_t r = 0; r < rows.size(); ++r)
+            for (size_t c = 0; c < columns.size(); ++c)
+                batch_values[c * rows.size() + r] = rows[r][c];
+        std::vector<RowCache> batch_caches(rows.size());
+        std::vector<RowContext> contexts;
+        for (size_t r = 0; r < rows.size(); ++r)
+            contexts.push_back(RowContext{slots, slot_indices, RowValues(&batch_values[r], columns.size(), rows.size()),
+                                          batch_caches[r], execution});
+        const std::span<const std::string_view> status_column(&batch_values[2 * rows.size()], rows.size());
+        std::vector<std::string> results(rows.size());
+
+        checksum = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < row_count; n += rows.size())
+        {
+            for (auto &cache : batch_caches)
+                cache.next_row();
+            apply_rule_batch(root, status_column, contexts, results);
+            for (const auto &result : results)
+                checksum += result.size();
+        }
+        elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << label << " (batch): " << elapsed / row_count << " ns/row (checksum " << checksum << ")\n";
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include "pg_anonymous/Crypto.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct Vector
+{
+    const char *name;
+    const char *key;
+    const char *plaintext;
+    const char *ciphertext;
+};
+
+// The NIST SP 800-38G FF1 samples with an empty tweak (Ff1Cipher has no tweak): samples 1, 4 and 7, radix 10.
+const Vector kVectors[] = {
+    {"FF1 sample 1 (AES-128)", "2B7E151628AED2A6ABF7158809CF4F3C", "0123456789", "2433477484"},
+    {"FF1 sample 4 (AES-192)", "2B7E151628AED2A6ABF7158809CF4F3CEF4359D8D580AA4F", "0123456789", "2830668132"},
+    {"FF1 sample 7 (AES-256)", "2B7E151628AED2A6ABF7158809CF4F3CEF4359D8D580AA4F7F036D6F04FC6A94", "0123456789",
+     "6657667009"},
+};
+
+std::vector<uint16_t> numerals_of(const std::string &digits)
+{
+    std::vector<uint16_t> numerals;
+    for (char c : digits)
+        numerals.push_back(static_cast<uint16_t>(c - '0'));
+    return numerals;
+}
+
+std::string digits_of(const std::vector<uint16_t> &numerals)
+{
+    std::string digits;
+    for (uint16_t numeral : numerals)
+        digits += static_cast<char>('0' + numeral);
+    return digits;
+}
+
+bool expect(bool ok, const std::string &what)
+{
+    std::cout << (ok ? "ok    " : "FAIL  ") << what << "\n";
+    return ok;
+}
+
+} // namespace
+
+/**
+ * @brief Checks Ff1Cipher against the SP 800-38G sample vectors, in both directions, and checks that it refuses
+ * domains smaller than Ff1Cipher::kMinDomain. Exits with status 1 on any failure.
+ */
+int main()
+{
+    bool passed = true;
+    for (const Vector &vector : kVectors)
+    {
+        const Ff1Cipher cipher(vector.key);
+        std::vector<uint16_t> numerals = numerals_of(vector.plaintext);
+        cipher.transform(numerals, 10, false);
+        const std::string encrypted = digits_of(numerals);
+        passed &= expect(encrypted == vector.ciphertext,
+                         std::string(vector.name) + " encrypts to " + encrypted + ", expected " + vector.ciphertext);
+        cipher.transform(numerals, 10, true);
+        passed &= expect(digits_of(numerals) == vector.plaintext, std::string(vector.name) + " decrypts back");
+    }
+
+    // radix^length must reach 10^6: 6 decimal digits, 20 bits, 4 base-36 characters.
+    const struct
+    {
+        unsigned radix;
+        size_t length;
+    } kMinimums[] = {{10, 6}, {2, 20}, {36, 4}, {Ff1Cipher::kMaxRadix, 2}};
+    const Ff1Cipher cipher("2B7E151628AED2A6ABF7158809CF4F3C");
+    for (const auto &minimum : kMinimums)
+    {
+        const std::string label = "radix " + std::to_string(minimum.radix) + " ";
+        passed &= expect(Ff1Cipher::min_length(minimum.radix) == minimum.length,
+                         label + "needs " + std::to_string(Ff1Cipher::min_length(minimum.radix)) + " numerals");
+
+        std::vector<uint16_t> shortest(minimum.length, 1), too_short(minimum.length - 1, 1);
+        bool refused = false;
+        try
+        {
+            cipher.transform(too_short, minimum.radix, false);
+        }
+        catch (const CryptoError &)
+        {
+            refused = true;
+        }
+        passed &= expect(refused, label + "refuses " + std::to_string(too_short.size()) + " numerals");
+        cipher.transform(shortest, minimum.radix, false);
+    }
+
+    std::cout << (passed ? "all FF1 checks passed\n" : "FF1 checks failed\n");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+#include "pg_anonymous/Regex.hpp"
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+
+const std::vector<std::string> kPatterns{
+    // Literals, classes and escapes
+    "abc", "a.c", "[a-c]+", "[^0-9]+", "[\\d.-]+", "\\w+@\\w+\\.com", "\\s+", "\\S+", "\\x41\\u0062", "[\\]\\\\]",
+    "\\.", "\\t|\\n", "[A-Za-z_][A-Za-z0-9_]*",
+    // Anchors and alternation
+    "^a", "b$", "^$", "^(a|ab)(c|bcd)(d*)$", "cat|category|dog", "(a|b|c)+", "(?:x|xy)z", "^(?:\\+?1[ -]?)?\\d{3}",
+    // Repetition
+    "a*", "a+?", "a??b", "a{2}", "a{2,}", "a{1,3}?", "(ab){1,2}", "x*y*z*", "(a*)*", "(a*)+b", "(a|ab)*c",
+    "[0-9]{3}-[0-9]{4}", ".*", ".*?", "(.*?)@(.*)", "^(\\d+)\\.(\\d{2})$",
+    // Captures
+    "(a)(b)?(c)", "((a)|(b))+", "(a(b(c)))", "(\\d+)-(\\d+)-(\\d+)", "^([^@]+)@(.+)$", "(?:(a)|b)+",
+    "(a+|b+)*c", "(x)?(x)?y",
+    // Word boundaries
+    "\\bfoo\\b", "\\Bo", "\\b\\w{3}\\b",
+};
+
+// Nested loops that make std::regex backtrack exponentially; only run against the short subjects.
+const std::vector<std::string> kBacktrackingPatterns{
+    "^(a*?(?:.*?)(.)?)*c{1,2}[ab]",
+    "(a*)*b",
+    "((a|b)*?c*)+d",
+    "(?:(a)|(b)|(\\d))*?\\d",
+};
+constexpr size_t kMaxBacktrackingSubject = 8;
+
+const std::vector<std::string> kSubjects{
+    "",
+    "a",
+    "abc",
+    "abcd",
+    "aaaa",
+    "ababab",
+    "ccb111",
+    "xyz",
+    "xxy",
+    "abbcd",
+    "foo bar foobar",
+    "john.doe@mail.example.com",
+    "user@example.com",
+    "+1 555-123-4567",
+    "123.45",
+    "2024-10-17",
+    "A\tb\nC",
+    "cat category dog",
+    "a]b\\c",
+    "Ab",
+};
+
+std::string describe(const RegexMatch &match, size_t groups)
+{
+    std::string text;
+    for (size_t i = 0; i < groups; ++i)
+    {
+        text += " $" + std::to_string(i) + "=";
+        text += match.matched(i) ? "\"" + std::string(match.group(i)) + "\"" : "unset";
+    }
+    return text;
+}
+
+/** Whether capturing group `n` is, or lies inside, a group repeated by a quantifier. */
+bool in_quantified_group(const std::string &pattern, size_t n)
+{
+    size_t captures = 0, depth = 0;
+    size_t enclosing = 0; // depth of the innermost open group that is group n or contains it; 0 before or after
+    for (size_t i = 0; i < pattern.size(); ++i)
+    {
+        if (pattern[i] == '\\')
+        {
+            ++i;
+        }
+        else if (pattern[i] == '[')
+        {
+            for (++i; i < pattern.size() && pattern[i] != ']'; ++i)
+                i += pattern[i] == '\\';
+        }
+        else if (pattern[i] == '(')
+        {
+            ++depth;
+            if (pattern.compare(i, 2, "(?") != 0 && ++captures == n)
+                enclosing = depth;
+        }
+        else if (pattern[i] == ')')
+        {
+            if (enclosing != 0 && depth == enclosing)
+            {
+                if (i + 1 < pattern.size() && std::string_view("*+?{").find(pattern[i + 1]) != std::string_view::npos)
+                    return true;
+                --enclosing;
+            }
+            --depth;
+        }
+    }
+    return false;
+}
+
+struct Tally
+{
+    size_t compared = 0;
+    size_t known = 0;
+    size_t failures = 0;
+};
+
+void compare(const Regex &nfa, const Regex &reference, const std::string &subject, Tally &tally)
+{
+    const std::string &pattern = nfa.pattern();
+    const size_t groups = nfa.group_count() + 1;
+    for (const bool anchored : {true, false})
+    {
+        RegexMatch ours, theirs;
+        const bool found = anchored ? nfa.match(subject, ours) : nfa.search(subject, 0, ours);
+        const bool expected = anchored ? reference.match(subject, theirs) : reference.search(subject, 0, theirs);
+        ++tally.compared;
+
+        bool same = found == expected, capture_only = false;
+        for (size_t g = 0; same && found && g < groups; ++g)
+        {
+            if (ours.matched(g) == theirs.matched(g) &&
+                (!ours.matched(g) || (ours.begin(g) == theirs.begin(g) && ours.end(g) == theirs.end(g))))
+                continue;
+            if (g > 0 && in_quantified_group(pattern, g))
+                capture_only = true;
+            else
+                same = false;
+        }
+        if (same && !capture_only)
+            continue;
+        ++(same ? tally.known : tally.failures);
+        std::cout << (same ? "known " : "FAIL  ") << (anchored ? "match  " : "search ") << pattern << " on \""
+                  << subject << "\":\n  linear:" << (found ? describe(ours, groups) : " no match")
+                  << "\n  std:   " << (expected ? describe(theirs, groups) : " no match") << "\n";
+    }
+
+    ++tally.compared;
+    const std::string replaced = nfa.replace(subject, "<$&>"), expected = reference.replace(subject, "<$&>");
+    if (replaced != expected)
+    {
+        ++tally.failures;
+        std::cout << "FAIL  replace " << pattern << " on \"" << subject << "\": \"" << replaced << "\" vs \""
+                  << expected << "\"\n";
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Runs every pattern of a fixed corpus through the linear-time engine and through std::regex, over a fixed
+ * set of subjects, and compares match(), search() and replace().
+ * Whether a match is found and where it begins and ends must agree. Captures must agree too, except inside a
+ * quantified group, where the two engines keep different iterations (see the Regex class notes); those differences
+ * are counted and printed but do not fail the check.
+ * Exits with status 1 on any other difference.
+ */
+int main()
+{
+    Tally tally;
+    for (const std::string &pattern : kPatterns)
+    {
+        const Regex nfa(pattern, Regex::Engine::Nfa), reference(pattern, Regex::Engine::Std);
+        for (const std::string &subject : kSubjects)
+            compare(nfa, reference, subject, tally);
+    }
+    for (const std::string &pattern : kBacktrackingPatterns)
+    {
+        const Regex nfa(pattern, Regex::Engine::Nfa), reference(pattern, Regex::Engine::Std);
+        for (const std::string &subject : kSubjects)
+        {
+            if (subject.size() <= kMaxBacktrackingSubject)
+                compare(nfa, reference, subject, tally);
+        }
+    }
+    std::cout << tally.compared << " comparisons, " << tally.known << " known capture differences, " << tally.failures
+              << " failures\n";
+    return tally.failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Kernels.hpp"
+#include "RowExecutor.hpp"
+#include "Rules.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// --- Columnar Batch Execution ---
+
+/**
+ * @brief Executes a COPY block's column rules a batch of rows at a time instead of row by row.
+ * Rows are split into per-column value arrays; each column's rule then runs over the whole column before the next
+ * one starts, keeping its code and state hot, and the output rows are assembled at the end.
+ * Every column rule still sees its rows in input order, so random streams, memo caches and dictionaries used by
+ * one column give the same output as the row-by-row path. Only a dict() shared by several columns of the same
+ * table can see its values first from another column than it would row by row.
+ */
+class BatchExecutor
+{
+  public:
+    static constexpr size_t kDefaultRows = 4096;
+
+    explicit BatchExecutor(size_t capacity = kDefaultRows);
+
+    /**
+     * @brief Starts a COPY block. The slots, indices, rules and execution context must stay alive until the block is
+     * flushed.
+     */
+    void begin(const RowSlots &slots, const std::vector<size_t> &slot_indices,
+               const std::vector<const IRule *> &column_rules, ExecutionContext &execution);
+
+    /**
+     * @brief Queues the block's `ordinal`-th data row, taking over the line's buffer. Writes out the pending batch
+     * first when it is full; `out` is a std::ostream or a std::string to append to.
+     */
+    template <typename Output> void push(std::string &line, uint64_t ordinal, Output &out)
+    {
+        if (rows_ == capacity_)
+            flush(out);
+        queue(line, ordinal);
+    }
+
+    /**
+     * @brief Evaluates and writes the pending rows. Call before anything else is written to `out`.
+     * @throws RowError if a rule throws; the pending rows are dropped.
+     */
+    void flush(std::ostream &out);
+
+    /** Evaluates the pending rows and appends them to `out`. */
+    void flush(std::string &out);
+
+  private:
+    void queue(std::string &line, uint64_t ordinal);
+
+    size_t capacity_;
+    const RowSlots *slots_ = nullptr;
+    const std::vector<size_t> *slot_indices_ = nullptr;
+    ExecutionContext *execution_ = nullptr;
+    size_t width_ = 0;                  // columns in the COPY header
+    std::vector<RuleRef> rules_;        // one per ruled column
+    std::vector<size_t> ruled_columns_; // the column of each rule
+    std::vector<size_t> result_slots_;  // per column, its index in rules_ and results_ (RowSlots::npos if none)
+
+    size_t rows_ = 0;
+    std::vector<std::string> lines_;       // per row; the values below point into them
+    std::vector<std::string_view> values_; // column-major: values_[column * capacity_ + row]
+    std::vector<size_t> field_counts_;     // per row, capped at the column count
+    std::vector<uint64_t> ordinals_;       // per row, its position in the COPY block
+    std::vector<std::string_view> tails_;  // per row, fields past the COPY column list, passed through
+    std::vector<RowCache> caches_;         // per row, so match slots are still shared across columns
+    std::vector<RowContext> contexts_;
+    std::vector<std::vector<std::string>> results_; // per ruled column
+    std::string output_;
+    FindTabsKernel find_tabs_;
+    std::vector<size_t> tab_offsets_; // push() scratch, one per column
+};
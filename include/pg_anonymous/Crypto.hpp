@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct evp_cipher_ctx_st;
+struct evp_md_ctx_st;
+
+// --- Keyed Cryptographic Hashing ---
+
+class CryptoError : public std::runtime_error
+{
+  public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief Resolves a key argument from the config. "env:NAME" reads the environment variable NAME so secrets can stay
+ * out of the YAML file; anything else is the key itself.
+ * @throws CryptoError if the variable is unset or the key is empty.
+ */
+std::string resolve_key(const std::string &spec);
+
+/**
+ * @brief HMAC-SHA256 (RFC 2104) over OpenSSL EVP. The key is absorbed once into inner and outer SHA-256 states;
+ * each call copies them into a per-thread working context, so hashing a value costs two compressions plus the
+ * value itself, with no allocation and no key schedule.
+ */
+class HmacSha256
+{
+  public:
+    static constexpr size_t kDigestSize = 32;
+    using Digest = std::array<unsigned char, kDigestSize>;
+
+    /** @throws CryptoError if OpenSSL cannot provide SHA-256. */
+    explicit HmacSha256(std::string_view key);
+    ~HmacSha256();
+
+    HmacSha256(const HmacSha256 &) = delete;
+    HmacSha256 &operator=(const HmacSha256 &) = delete;
+
+    Digest digest(std::string_view data) const;
+
+  private:
+    evp_md_ctx_st *inner_ = nullptr;
+    evp_md_ctx_st *outer_ = nullptr;
+};
+
+enum class DigestEncoding
+{
+    Hex,
+    Base32,
+    Numeric
+};
+
+std::optional<DigestEncoding> parse_digest_encoding(const std::string &name);
+
+/**
+ * @brief Renders a digest as lowercase hex, unpadded RFC 4648 base32 (lowercase), or decimal digits.
+ * `length` truncates the text; 0 keeps the full encoding (20 digits for Numeric, which is zero-padded).
+ */
+std::string encode_digest(const unsigned char *digest, size_t size, DigestEncoding encoding, size_t length);
+
+// --- Format-Preserving Encryption ---
+
+/**
+ * @brief NIST SP 800-38G FF1 over OpenSSL AES, with an empty tweak. The AES key schedule is expanded once; each
+ * thread keeps its own copy of the keyed context. Numeral strings use BIGNUM arithmetic, so any length works.
+ * check/ff1_vectors.cpp verifies it against the SP 800-38G samples that use an empty tweak.
+ */
+class Ff1Cipher
+{
+  public:
+    static constexpr unsigned kMaxRadix = 1 << 16;
+    static constexpr uint64_t kMinDomain = 1'000'000; // SP 800-38G: radix^minlen >= 10^6
+
+    /** The fewest numerals FF1 accepts at `radix`: at least two, and enough for kMinDomain values. */
+    static size_t min_length(unsigned radix);
+
+    /**
+     * @brief `key` is an AES key written as 32, 48 or 64 hex digits; any other text is hashed with SHA-256 into an
+     * AES-256 key.
+     * @throws CryptoError if OpenSSL rejects the key.
+     */
+    explicit Ff1Cipher(std::string_view key);
+    ~Ff1Cipher();
+
+    Ff1Cipher(const Ff1Cipher &) = delete;
+    Ff1Cipher &operator=(const Ff1Cipher &) = delete;
+
+    /**
+     * @brief Encrypts (or decrypts) `numerals`, each below `radix`, in place.
+     * @throws CryptoError if there are fewer than min_length(radix) numerals: smaller domains can be inverted by
+     * enumerating them.
+     */
+    void transform(std::vector<uint16_t> &numerals, unsigned radix, bool decrypt) const;
+
+  private:
+    evp_cipher_ctx_st *cipher_ = nullptr;
+    uint64_t id_; // identifies this key in the per-thread context cache
+};
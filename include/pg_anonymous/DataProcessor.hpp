@@ -1,6 +1,10 @@
 #pragma once
 
+#include "BatchExecutor.hpp"
+#include "ParallelExecutor.hpp"
+#include "RowExecutor.hpp"
 #include "Rules.hpp"
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -8,20 +12,47 @@
 #include <vector>
 #include <yaml-cpp/yaml.h>
 
-using ReplacementRules = std::map<std::string, std::map<std::string, std::shared_ptr<IRule>>>;
+struct TableRules
+{
+    RowSlots row_slots;
+    std::map<std::string, std::shared_ptr<IRule>> columns;
+};
+
+using ReplacementRules = std::map<std::string, TableRules>;
 using ReplacementCatalog = std::map<std::string, std::vector<std::string>>;
 
+/**
+ * @brief Run-wide settings from the command line.
+ */
+struct ProcessorOptions
+{
+    // Every random rule draws from its own stream derived from the seed, so the same seed, config and input always
+    // produce the same output.
+    uint64_t seed = 0;
+    // Byte budget of each memoization cache; 0 disables memoization.
+    size_t cache_size = 0;
+    // In-memory bytes of each dict() dictionary before it spills to a temporary file.
+    size_t dictionary_memory = 64 << 20;
+    // Rows per columnar batch (see BatchExecutor); 0 evaluates row by row.
+    size_t batch_rows = 0;
+    // Worker threads evaluating rows (see ParallelExecutor); 1 evaluates on the reading thread.
+    size_t threads = 1;
+};
+
 class DataProcessor
 {
   public:
-    DataProcessor(const std::string &config_file_path);
+    DataProcessor(const std::string &config_file_path, const ProcessorOptions &options);
 
     int process_dump(const std::string &input_file_path, const std::string &output_file_path);
 
   private:
     YAML::Node config_;
+    ProcessorOptions options_;
+    RuleEnvironment environment_; // outlives load_rules: dict() rules keep sharing its dictionaries
     ReplacementCatalog replacement_catalog_;
     ReplacementRules replacement_rules_;
+    std::vector<std::pair<std::string, std::shared_ptr<MemoizedRule>>> memo_caches_; // labelled by table.column
 
     enum class ParserState
     {
@@ -30,6 +61,11 @@ class DataProcessor
     };
 
     ReplacementCatalog load_catalog(const YAML::Node &config);
-    ReplacementRules load_rules(const YAML::Node &config) const;
+    ReplacementRules load_rules(const YAML::Node &config);
     void parse_copy_columns(const std::string &raw_columns, std::vector<std::string> &columns) const;
+    std::vector<const IRule *> resolve_column_rules(const TableRules &table_rules,
+                                                    const std::vector<std::string> &columns) const;
+    static bool is_copy_end_marker(const std::string &line);
+    static int discard_output(std::ofstream &out, const std::string &output_file_path);
+    void report_cache_stats(const std::vector<const ExecutionContext *> &contexts) const;
 };
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// --- Calendar Dates ---
+
+/** Days between the first and last date PostgreSQL can store (4714-11-24 BC and 5874897-12-31). */
+constexpr int64_t kPgDateSpanDays = 2'147'483'494;
+
+/**
+ * @brief Days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant's days_from_civil). `month` is 1-12.
+ */
+int64_t days_from_civil(int64_t year, unsigned month, unsigned day);
+
+/** The inverse of days_from_civil(). */
+void civil_from_days(int64_t days, int64_t &year, unsigned &month, unsigned &day);
+
+/**
+ * @brief A date, timestamp or timestamptz as PostgreSQL prints it in COPY output with the default ISO DateStyle:
+ * "YYYY-MM-DD[ HH:MM:SS[.ffffff][±HH[:MM[:SS]]]]".
+ */
+struct PgDateTime
+{
+    int64_t days = 0; // see days_from_civil()
+    bool has_time = false;
+    unsigned hour = 0;
+    unsigned minute = 0;
+    unsigned second = 0;
+    std::string_view fraction; // ".ffffff", or empty; points into the parsed text
+    std::string_view zone;     // "+HH[:MM[:SS]]", or empty; points into the parsed text
+
+    /**
+     * @brief Parses one value in a single fixed-format pass. BC dates, 'infinity', NULL markers and anything that is
+     * not a valid calendar date are rejected.
+     */
+    static bool parse(std::string_view text, PgDateTime &value);
+
+    /**
+     * @brief Appends the value in the format it was parsed from.
+     * @return false, appending nothing, if the date left the AD years PostgreSQL prints without a BC suffix.
+     */
+    bool format(std::string &out) const;
+};
+
+enum class DateUnit
+{
+    Year,
+    Quarter,
+    Month,
+    Week, // ISO weeks, starting on Monday
+    Day,
+    Hour,
+    Minute
+};
+
+std::optional<DateUnit> parse_date_unit(std::string_view name);
+
+/**
+ * @brief Sets every field below `unit` to its start, like PostgreSQL's date_trunc(). Fractional seconds are dropped
+ * and the time zone is kept.
+ */
+void truncate_datetime(PgDateTime &value, DateUnit unit);
+
+/** Whole years from `birth` to `reference` (negative if `reference` is earlier). */
+int64_t years_between(int64_t birth_days, int64_t reference_days);
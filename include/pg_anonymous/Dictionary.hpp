@@ -0,0 +1,156 @@
+#pragma once
+
+#include "Crypto.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// --- Pseudonym Dictionaries ---
+
+/**
+ * @brief A named original -> pseudonym mapping shared by every template that references it, so a value gets the
+ * same pseudonym in every table and COPY block of the dump.
+ * Entries live in an open-addressing table whose keys and values are packed into one arena. When table and arena
+ * outgrow the memory budget they are written to the spill file as an immutable on-disk hash table segment, and
+ * memory starts over. Each segment keeps a one-byte tag per slot in memory, so a lookup only reads the disk when
+ * a tag matches. Segments are merged like a binary counter (the newest two whenever the older one holds no more
+ * entries than the newer) and never number more than kMaxSegments, so a miss probes O(log spills) tag arrays and
+ * the tags cost at most four bytes per spilled entry. A merge holds the slot tables it rewrites in memory while it
+ * runs; the space of the merged segments is released where the file system supports punching holes.
+ * One mutex guards all of this: lookups, inserts, spills and merges of a dictionary are serialized, so threads can
+ * share it safely, but under --threads every dict() call on the same dictionary waits its turn, including while
+ * another thread reads the spill file.
+ * Originals never reach the disk: segments store an HMAC of each key under a random per-dictionary key, and the
+ * spill file is created 0600 with mkstemp and unlinked at once, so it disappears with the process however it ends.
+ */
+class PseudonymDictionary
+{
+  public:
+    /** An empty `spill_directory` keeps the dictionary in memory whatever its size. */
+    PseudonymDictionary(std::string name, size_t memory_budget, std::filesystem::path spill_directory);
+    ~PseudonymDictionary();
+
+    PseudonymDictionary(const PseudonymDictionary &) = delete;
+    PseudonymDictionary &operator=(const PseudonymDictionary &) = delete;
+
+    /**
+     * @brief Looks `key` up in memory, then in the spilled segments from newest to oldest.
+     * @return true and sets `value` if the key has a pseudonym.
+     */
+    bool find(std::string_view key, std::string &value);
+
+    /**
+     * @brief Records the pseudonym of a key that find() did not know. If another thread recorded one for the key in
+     * the meantime, that one is kept and returned in `value` instead.
+     */
+    void insert(std::string_view key, std::string &value);
+
+    const std::string &name() const
+    {
+        return name_;
+    }
+    size_t size() const
+    {
+        return count_ + spilled_count_;
+    }
+    size_t segment_count() const
+    {
+        return segments_.size();
+    }
+
+  private:
+    struct Slot
+    {
+        uint64_t hash;
+        uint64_t offset; // into arena_ (memory) or the spill file (disk); kEmpty marks a free slot
+        uint32_t key_size; // on disk, always HmacSha256::kDigestSize
+        uint32_t value_size;
+    };
+
+    struct Segment
+    {
+        uint64_t records_offset;
+        uint64_t table_offset;
+        size_t count;
+        std::vector<uint8_t> tags; // one per slot; 0 = empty
+    };
+
+    /** A segment being appended to the spill file: records are buffered and written in chunks. */
+    struct SegmentWriter
+    {
+        uint64_t records_offset;
+        uint64_t written;
+        std::string records;
+        std::vector<Slot> table;
+        size_t count;
+    };
+
+    static constexpr uint64_t kEmpty = UINT64_MAX;
+    static constexpr size_t kMaxSegments = 16;
+
+    static uint8_t tag_of(uint64_t hash)
+    {
+        return static_cast<uint8_t>(hash >> 56) | 1;
+    }
+
+    size_t memory_used() const
+    {
+        return slots_.size() * sizeof(Slot) + arena_.capacity();
+    }
+
+    void grow();
+    bool open_spill_file();
+    void spill();
+    SegmentWriter start_segment(size_t count) const;
+    bool add_record(SegmentWriter &writer, uint64_t hash, std::string_view digest, std::string_view value);
+    bool flush_records(SegmentWriter &writer);
+    bool finish_segment(SegmentWriter &writer, Segment &segment);
+    void merge_segments();
+    bool merge_newest_segments();
+    bool copy_records(const Segment &segment, SegmentWriter &writer);
+    bool find_locked(std::string_view key, uint64_t hash, std::string &value);
+    bool find_on_disk(std::string_view key, uint64_t hash, std::string &value);
+    static void place(std::vector<Slot> &slots, const Slot &slot);
+
+    std::mutex mutex_;
+    std::string name_;
+    size_t memory_budget_;
+    std::filesystem::path spill_directory_;
+    int spill_fd_ = -1;
+    uint64_t spill_size_ = 0;
+    std::unique_ptr<HmacSha256> spill_key_;
+
+    std::vector<Slot> slots_;
+    std::string arena_;
+    size_t count_ = 0;
+
+    std::vector<Segment> segments_;
+    size_t spilled_count_ = 0;
+    std::string scratch_;
+};
+
+/**
+ * @brief The dictionaries of one run, created on first reference by name.
+ */
+class PseudonymDictionaries
+{
+  public:
+    explicit PseudonymDictionaries(size_t memory_budget) : memory_budget_(memory_budget)
+    {
+    }
+
+    std::shared_ptr<PseudonymDictionary> get(const std::string &name);
+
+  private:
+    size_t memory_budget_;
+    std::optional<std::filesystem::path> spill_directory_; // resolved on first use; empty if there is none
+    std::map<std::string, std::shared_ptr<PseudonymDictionary>> dictionaries_;
+};
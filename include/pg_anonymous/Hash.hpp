@@ -0,0 +1,139 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// --- Stable Hashing ---
+
+/**
+ * @brief A keyed 64-bit hash whose output depends only on the bytes and the seed, never on the platform or the
+ * standard library (unlike std::hash), so anonymized values stay reproducible across machines and builds.
+ * Input is consumed 32 bytes at a time in four independent 64-bit lanes mixed with 32x32->64 multiplies, then
+ * 8/4/1 bytes at a time, and finished with the XXH64 avalanche.
+ */
+namespace stable_hash
+{
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+constexpr size_t kStripeSize = 32;
+constexpr size_t kLanes = 4;
+constexpr uint64_t kLaneKeys[kLanes] = {0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL, 0xDB979083E96DD4DEULL,
+                                        0x1F67B3B7A4A44072ULL};
+
+inline uint64_t load64(const char *p)
+{
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    if constexpr (std::endian::native == std::endian::big)
+        value = __builtin_bswap64(value);
+    return value;
+}
+
+inline uint32_t load32(const char *p)
+{
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    if constexpr (std::endian::native == std::endian::big)
+        value = __builtin_bswap32(value);
+    return value;
+}
+
+inline uint64_t avalanche(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+/**
+ * @brief Mixes one 8-byte word into a lane: the word's halves are multiplied together and the raw word is added,
+ * so no input bits are lost even when a product is zero.
+ */
+inline uint64_t accumulate(uint64_t acc, uint64_t word, uint64_t lane_key)
+{
+    const uint64_t keyed = word ^ lane_key;
+    return acc + (keyed & 0xFFFFFFFFULL) * (keyed >> 32) + word;
+}
+
+/**
+ * @brief Hashes the whole 32-byte stripes at `p` and returns the combined lane state; `p` and `n` are advanced past
+ * them.
+ */
+inline uint64_t hash_stripes(const char *&p, size_t &n, uint64_t seed)
+{
+    uint64_t acc[kLanes] = {seed + kPrime1, seed ^ kPrime2, seed + kPrime3, seed ^ kPrime4};
+    while (n >= kStripeSize)
+    {
+        for (size_t lane = 0; lane < kLanes; ++lane)
+            acc[lane] = accumulate(acc[lane], load64(p + 8 * lane), kLaneKeys[lane]);
+        p += kStripeSize;
+        n -= kStripeSize;
+    }
+    return std::rotl(acc[0], 1) + std::rotl(acc[1], 7) + std::rotl(acc[2], 12) + std::rotl(acc[3], 18);
+}
+
+/**
+ * @brief Hashes the last (fewer than 32) bytes into `h` and finishes it.
+ */
+inline uint64_t hash_tail(const char *p, size_t n, uint64_t h)
+{
+    while (n >= 8)
+    {
+        h ^= std::rotl(load64(p) * kPrime2, 31) * kPrime1;
+        h = std::rotl(h, 27) * kPrime1 + kPrime4;
+        p += 8;
+        n -= 8;
+    }
+    if (n >= 4)
+    {
+        h ^= uint64_t(load32(p)) * kPrime1;
+        h = std::rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+        n -= 4;
+    }
+    while (n > 0)
+    {
+        h ^= static_cast<unsigned char>(*p) * kPrime5;
+        h = std::rotl(h, 11) * kPrime1;
+        ++p;
+        --n;
+    }
+    return avalanche(h);
+}
+
+inline uint64_t hash(std::string_view data, uint64_t seed = 0)
+{
+    const char *p = data.data();
+    size_t n = data.size();
+    uint64_t h = n >= kStripeSize ? hash_stripes(p, n, seed) : seed + kPrime5;
+    h += data.size() * kPrime1;
+    return hash_tail(p, n, h);
+}
+
+/**
+ * @brief hashes[i] = hash(values[i], seed) for a whole batch of values. Values shorter than a stripe are hashed
+ * several at a time in SIMD lanes (AVX2 or AVX-512, chosen by the CPU) with results identical to hash().
+ */
+void hash_many(const std::string_view *values, size_t count, uint64_t seed, uint64_t *hashes);
+
+/**
+ * @brief Maps a hash uniformly onto [0, range) with a multiply-shift instead of a division. `range` must fit in
+ * 32 bits; the high half of the hash is used since it is the best mixed.
+ */
+inline size_t reduce(uint64_t hash, size_t range)
+{
+    return static_cast<size_t>(((hash >> 32) * static_cast<uint64_t>(range)) >> 32);
+}
+
+} // namespace stable_hash
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// --- CPU Kernel Dispatch ---
+
+/**
+ * @brief Instruction set levels with dedicated kernels. The build targets the baseline ISA; wider kernels are
+ * compiled with function target attributes and only called when the CPU reports support, so one binary runs on
+ * every host of the fleet.
+ */
+enum class KernelLevel
+{
+    Scalar,
+    Sse42,
+    Avx2,
+    Avx512,
+    Neon
+};
+
+/**
+ * @brief Writes the offsets of up to `max` tab characters in [data, data + size) to `offsets`, in order.
+ * @return How many were written; fewer than `max` means there are no more tabs.
+ */
+using FindTabsKernel = size_t (*)(const char *data, size_t size, size_t *offsets, size_t max);
+
+/** Multi-lane stable_hash::hash over short values (see stable_hash::hash_many). */
+using HashLanesKernel = void (*)(const std::string_view *values, size_t count, uint64_t seed, uint64_t *hashes);
+
+/**
+ * @brief The kernels in use, resolved once. Calls go through these pointers instead of re-checking the CPU.
+ */
+struct KernelSet
+{
+    KernelLevel level = KernelLevel::Scalar;
+    FindTabsKernel find_tabs = nullptr;
+    HashLanesKernel hash_lanes = nullptr; // nullptr: hash with the scalar loop
+    bool hash_lanes_always = false;       // false: only for batches where lanes measured faster
+};
+
+/**
+ * @brief The active kernel set. Detected from the CPU on first use unless select_kernels() ran before.
+ */
+const KernelSet &active_kernels();
+
+/**
+ * @brief Overrides detection, e.g. to benchmark one level against another: "auto", "scalar", "sse4.2", "avx2",
+ * "avx512" or "neon". A forced level runs all of its kernels, including those auto-detection would skip as
+ * slower than scalar. Call before any kernel runs.
+ * @return false if the name is unknown or the CPU does not support that level.
+ */
+bool select_kernels(std::string_view name);
+
+/** The levels this CPU can run, scalar first. */
+std::vector<KernelLevel> supported_kernel_levels();
+
+std::string_view kernel_level_name(KernelLevel level);
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// --- Memoization ---
+
+struct MemoStats
+{
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+    uint64_t evictions = 0;
+    bool disabled = false;
+
+    double hit_rate() const
+    {
+        return lookups ? double(hits) / double(lookups) : 0.0;
+    }
+};
+
+/**
+ * @brief Bounded string -> string cache: open addressing with linear probing and backward-shift deletion, evicting
+ * with the CLOCK approximation of LRU once the byte budget (slot array plus keys and values) is reached.
+ * It watches its own hit rate and turns itself off, releasing its memory, when caching does not pay.
+ */
+class MemoCache
+{
+  public:
+    // Hit rate is judged over windows of this many lookups; a window below kMinHitRate disables the cache.
+    static constexpr uint64_t kWindow = 1 << 16;
+    static constexpr double kMinHitRate = 0.25;
+
+    explicit MemoCache(size_t byte_budget);
+
+    bool enabled() const
+    {
+        return !stats_.disabled;
+    }
+
+    /**
+     * @brief The cached value for `key`, or nullptr on a miss. `hash` must be stable_hash::hash(key).
+     */
+    const std::string *find(std::string_view key, uint64_t hash);
+
+    /** Caches `value` for a key that just missed, evicting older entries to stay within budget. */
+    void insert(std::string_view key, uint64_t hash, std::string value);
+
+    const MemoStats &stats() const
+    {
+        return stats_;
+    }
+
+  private:
+    struct Entry
+    {
+        uint64_t hash = 0;
+        std::string key;
+        std::string value;
+        bool used = false;
+        bool referenced = false;
+    };
+
+    // Heap bytes of an entry; the slot array itself is accounted separately.
+    static size_t entry_bytes(const Entry &entry)
+    {
+        return entry.key.size() + entry.value.size();
+    }
+
+    void grow();
+    void evict_one();
+    void erase(size_t slot);
+    void end_window();
+
+    std::vector<Entry> slots_;
+    size_t count_ = 0;
+    size_t bytes_ = 0;
+    size_t budget_;
+    size_t hand_ = 0;
+    uint64_t window_lookups_ = 0;
+    uint64_t window_hits_ = 0;
+    MemoStats stats_;
+};
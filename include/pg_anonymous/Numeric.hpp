@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// --- Numeric Text ---
+
+/**
+ * @brief An integer or numeric value as PostgreSQL prints it in COPY output: "[-]digits[.digits]", held exactly as
+ * units of 10^-scale so that rewriting it keeps the column's precision.
+ */
+struct DecimalText
+{
+    static constexpr unsigned kMaxDigits = 36; // leaves headroom in __int128 for noise and rounding
+
+    __int128 units = 0;
+    unsigned scale = 0; // digits after the decimal point
+
+    /**
+     * @brief Parses one value. NaN, Infinity, exponents, values of more than kMaxDigits significant digits and
+     * values with more than kMaxDigits fractional digits are rejected; see parse_float() for the float columns.
+     */
+    static bool parse(std::string_view text, DecimalText &value);
+
+    /** Appends the value with exactly `scale` fractional digits. */
+    void format(std::string &out) const;
+
+    /**
+     * @brief Re-expresses the value with `new_scale` fractional digits, rounding half away from zero when digits
+     * are dropped.
+     * @return false if the result would not fit.
+     */
+    bool rescale(unsigned new_scale);
+
+    long double to_long_double() const;
+};
+
+/** Orders two decimals regardless of their scales. */
+int compare_decimals(DecimalText a, DecimalText b);
+
+/** Parses a finite float8/real value, including exponent notation. */
+bool parse_float(std::string_view text, double &value);
+
+/** Appends the shortest text that reads back as `value`. */
+void format_float(double value, std::string &out);
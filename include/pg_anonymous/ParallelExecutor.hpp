@@ -0,0 +1,96 @@
+#pragma once
+
+#include "BatchExecutor.hpp"
+#include "RowExecutor.hpp"
+#include "Rules.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// --- Parallel Execution ---
+
+/**
+ * @brief Evaluates a COPY block's rows on worker threads. Rows are queued in chunks; each worker transforms an
+ * equal, contiguous share of a chunk with its own ExecutionContext, and the shares are written out in input order.
+ * While the workers run one chunk, the caller reads the next.
+ * Rules are immutable and random rules are keyed by row ordinal, so the output is the same for any thread count.
+ */
+class ParallelExecutor
+{
+  public:
+    static constexpr size_t kRowsPerThread = 4096;
+
+    /**
+     * @brief Starts `threads` workers for rules compiled against `layout`. With `batch_rows` > 0 each worker
+     * evaluates its share column by column (see BatchExecutor).
+     */
+    ParallelExecutor(size_t threads, size_t batch_rows, const ExecutionLayout &layout);
+    ~ParallelExecutor();
+
+    ParallelExecutor(const ParallelExecutor &) = delete;
+    ParallelExecutor &operator=(const ParallelExecutor &) = delete;
+
+    /**
+     * @brief Starts a COPY block, after the previous one was flushed. The slots, indices and rules must stay alive
+     * until the block is flushed.
+     */
+    void begin(const RowSlots &slots, const std::vector<size_t> &slot_indices,
+               const std::vector<const IRule *> &column_rules);
+
+    /** Queues a data row, taking over the line's buffer. Hands the chunk to the workers when it is full. */
+    void push(std::string &line, std::ostream &out);
+
+    /**
+     * @brief Evaluates and writes every pending row. Call before anything else is written to `out`.
+     * @throws RowError (or whatever else escaped) from a rule on a worker thread, once all workers are idle again.
+     */
+    void flush(std::ostream &out);
+
+    /** The workers' execution contexts, e.g. to add up memo cache statistics. */
+    std::vector<const ExecutionContext *> contexts() const;
+
+  private:
+    struct Worker
+    {
+        ExecutionContext execution;
+        RowExecutor rows;
+        std::optional<BatchExecutor> batch;
+        size_t first = 0; // the worker's share of running_
+        size_t last = 0;
+        std::string output;
+        std::thread thread;
+
+        Worker(const ExecutionLayout &layout, size_t batch_rows);
+    };
+
+    void run(Worker &worker);
+    void transform(Worker &worker);
+    void dispatch(std::ostream &out);
+    void collect(std::ostream &out);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::string> chunk_;   // rows being queued
+    std::vector<std::string> running_; // rows handed to the workers
+    size_t chunk_rows_ = 0;
+    size_t running_rows_ = 0;
+    uint64_t chunk_ordinal_ = 0; // ordinal of the first row of each
+    uint64_t running_ordinal_ = 0;
+    bool in_flight_ = false;
+
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    uint64_t generation_ = 0; // bumped for every dispatched chunk
+    size_t pending_ = 0;      // workers still on it
+    bool stopping_ = false;
+    std::exception_ptr error_;
+};
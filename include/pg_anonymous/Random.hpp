@@ -0,0 +1,170 @@
+#pragma once
+
+#include "Hash.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// --- Random Number Generation ---
+
+/**
+ * @brief Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3"): ten rounds of a keyed
+ * bijection over a 128-bit counter. Output n of a stream is computed directly from n, so there is no state to step
+ * through or to share between threads.
+ * @return The 128-bit block for `counter` under `key`, as two 64-bit words.
+ */
+inline std::array<uint64_t, 2> philox4x32(uint64_t counter_low, uint64_t counter_high, uint64_t key)
+{
+    constexpr uint64_t kMultiplier0 = 0xD2511F53;
+    constexpr uint64_t kMultiplier1 = 0xCD9E8D57;
+    constexpr uint32_t kWeyl0 = 0x9E3779B9;
+    constexpr uint32_t kWeyl1 = 0xBB67AE85;
+
+    uint32_t c0 = static_cast<uint32_t>(counter_low), c1 = static_cast<uint32_t>(counter_low >> 32);
+    uint32_t c2 = static_cast<uint32_t>(counter_high), c3 = static_cast<uint32_t>(counter_high >> 32);
+    uint32_t k0 = static_cast<uint32_t>(key), k1 = static_cast<uint32_t>(key >> 32);
+    for (int round = 0; round < 10; ++round)
+    {
+        const uint64_t product0 = kMultiplier0 * c0;
+        const uint64_t product1 = kMultiplier1 * c2;
+        c0 = static_cast<uint32_t>(product1 >> 32) ^ c1 ^ k0;
+        c1 = static_cast<uint32_t>(product1);
+        c2 = static_cast<uint32_t>(product0 >> 32) ^ c3 ^ k1;
+        c3 = static_cast<uint32_t>(product0);
+        k0 += kWeyl0;
+        k1 += kWeyl1;
+    }
+    return {uint64_t(c1) << 32 | c0, uint64_t(c3) << 32 | c2};
+}
+
+/**
+ * @brief A counter-based random stream addressed by row: the values a rule draws for a row are a pure function of
+ * the stream key and the row ordinal, so any thread can compute any row's values and a run gives the same output
+ * whether its rows are evaluated by one thread or many.
+ */
+class CounterRng
+{
+    uint64_t key_;
+
+  public:
+    explicit CounterRng(uint64_t key) : key_(key)
+    {
+    }
+
+    /** The `index`-th 64-bit word drawn for `row`. */
+    uint64_t word(uint64_t row, uint64_t index) const
+    {
+        return philox4x32(row, index / 2, key_)[index % 2];
+    }
+
+    /** A uniform double in [0, 1) for `row`. */
+    double uniform(uint64_t row) const
+    {
+        return static_cast<double>(word(row, 0) >> 11) * 0x1p-53;
+    }
+
+    /**
+     * @brief Unbiased uniform integer in [0, range) for `row` by Lemire's multiply-and-reject: one multiply per
+     * value, and a division only on the rare rejection path, which draws the row's next words. `range` must be
+     * non-zero.
+     */
+    uint64_t below(uint64_t row, uint64_t range) const
+    {
+        const std::array<uint64_t, 2> first = philox4x32(row, 0, key_);
+        unsigned __int128 product = static_cast<unsigned __int128>(first[0]) * range;
+        uint64_t low = static_cast<uint64_t>(product);
+        if (low < range)
+        {
+            const uint64_t threshold = -range % range;
+            for (uint64_t index = 1; low < threshold; ++index)
+            {
+                product = static_cast<unsigned __int128>(index == 1 ? first[1] : word(row, index)) * range;
+                low = static_cast<uint64_t>(product);
+            }
+        }
+        return static_cast<uint64_t>(product >> 64);
+    }
+};
+
+/**
+ * @brief Hands out independent stream keys to the random rules of a config, all derived from one run seed.
+ * A stream depends only on the seed, the scope it is created in (a table column) and its position within that
+ * scope, so editing one column's template never reshuffles the values of another.
+ */
+class RandomStreams
+{
+    uint64_t seed_;
+    uint64_t scope_;
+    uint64_t table_scope_;
+    uint64_t next_index_ = 0;
+
+  public:
+    explicit RandomStreams(uint64_t seed)
+        : seed_(seed), scope_(stable_hash::hash({}, seed)), table_scope_(stable_hash::hash({}, seed))
+    {
+    }
+
+    uint64_t seed() const
+    {
+        return seed_;
+    }
+
+    void enter_scope(std::string_view table, std::string_view column)
+    {
+        std::string scope;
+        scope.reserve(table.size() + 1 + column.size());
+        scope.append(table).append(".").append(column);
+        scope_ = stable_hash::hash(scope, seed_);
+        table_scope_ = stable_hash::hash(table, seed_);
+        next_index_ = 0;
+    }
+
+    /** Where stream allocation stands, to resume after a nested scope. */
+    struct Position
+    {
+        uint64_t scope;
+        uint64_t table_scope;
+        uint64_t next_index;
+    };
+
+    Position position() const
+    {
+        return {scope_, table_scope_, next_index_};
+    }
+
+    void restore(const Position &position)
+    {
+        scope_ = position.scope;
+        table_scope_ = position.table_scope;
+        next_index_ = position.next_index;
+    }
+
+    /**
+     * @brief Scopes the streams of a dict() value template by the dictionary alone, so every column sharing the
+     * dictionary computes the same pseudonym for a value, whichever of them records it first.
+     */
+    void enter_dictionary_scope(std::string_view dictionary)
+    {
+        std::string scope = "dict:";
+        scope.append(dictionary);
+        scope_ = stable_hash::hash(scope, seed_);
+        table_scope_ = scope_;
+        next_index_ = 0;
+    }
+
+    CounterRng next_stream()
+    {
+        return CounterRng(stable_hash::avalanche(scope_ + ++next_index_ * stable_hash::kPrime1));
+    }
+
+    /**
+     * @brief A stream shared by every rule of the current table that asks for `name`, whatever its column. Rules
+     * drawing from it with the same row ordinal get the same numbers, e.g. one date offset for all of a row's dates.
+     */
+    CounterRng shared_stream(std::string_view name) const
+    {
+        return CounterRng(stable_hash::avalanche(table_scope_ ^ stable_hash::hash(name, seed_)));
+    }
+};
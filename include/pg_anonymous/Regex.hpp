@@ -0,0 +1,242 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// --- Regular Expressions ---
+
+class RegexError : public std::runtime_error
+{
+  public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief Capture offsets of a successful match over `subject`. Group n spans [begin(n), end(n)); groups that did
+ * not participate report npos.
+ */
+struct RegexMatch
+{
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    std::string_view subject;
+    std::vector<size_t> offsets;
+
+    size_t size() const
+    {
+        return offsets.size() / 2;
+    }
+    bool matched(size_t group) const
+    {
+        return group < size() && offsets[2 * group] != npos;
+    }
+    size_t begin(size_t group) const
+    {
+        return offsets[2 * group];
+    }
+    size_t end(size_t group) const
+    {
+        return offsets[2 * group + 1];
+    }
+    std::string_view group(size_t group) const
+    {
+        if (!matched(group))
+            return {};
+        return subject.substr(begin(group), end(group) - begin(group));
+    }
+};
+
+/**
+ * @brief A replacement format compiled once into literal, back-reference and runtime-value segments, so replacing
+ * assembles output straight from match offsets instead of re-parsing $-references for every match.
+ */
+class RegexFormat
+{
+  public:
+    struct Segment
+    {
+        enum class Kind
+        {
+            Literal,
+            Group,   // $&, $n, $nn
+            Prefix,  // $`
+            Suffix,  // $'
+            Dynamic  // a value supplied per call, inserted verbatim
+        };
+
+        Kind kind;
+        std::string text;
+        size_t index = 0; // group number, or position among the dynamic values
+    };
+
+    RegexFormat() = default;
+    explicit RegexFormat(std::string_view format)
+    {
+        add_format(format);
+    }
+
+    /**
+     * @brief Appends the segments of `format`. A trailing lone '$' is kept as a literal, as when it ends the whole
+     * format; dangling() reports it so callers can tell when it would have paired with a following value.
+     */
+    void add_format(std::string_view format);
+
+    /** Appends a placeholder for the next value passed to append(). */
+    void add_dynamic();
+
+    /** Whether the last segment added ended in a lone '$'. */
+    bool dangling() const
+    {
+        return dangling_;
+    }
+
+    size_t dynamic_count() const
+    {
+        return dynamic_count_;
+    }
+
+    /**
+     * @brief Appends the format expanded against `match`. $` starts at `prefix_begin`, the end of the previous match
+     * when replacing repeatedly.
+     */
+    void append(std::string &out, const RegexMatch &match, size_t prefix_begin,
+                std::span<const std::string> dynamic = {}) const;
+
+  private:
+    void add_literal(std::string_view text);
+
+    std::vector<Segment> segments_;
+    size_t dynamic_count_ = 0;
+    bool dangling_ = false;
+};
+
+/**
+ * @brief A compiled pattern. Implementations must be immutable after construction and safe to share across threads.
+ */
+class RegexBackend
+{
+  public:
+    virtual ~RegexBackend() = default;
+    /** Anchored match of the whole subject (regex_match semantics). */
+    virtual bool match(std::string_view subject, RegexMatch *match) const = 0;
+    /** Leftmost match starting at or after `start` (regex_search semantics). */
+    virtual bool search(std::string_view subject, size_t start, RegexMatch *match) const = 0;
+    /** Non-empty match beginning exactly at `start`; how replacement continues after an empty match. */
+    virtual bool match_non_empty_at(std::string_view subject, size_t start, RegexMatch *match) const = 0;
+    virtual size_t group_count() const = 0;
+    virtual bool linear_time() const = 0;
+};
+
+/**
+ * @brief ECMAScript-flavoured regular expression with a pluggable backend.
+ * The default backend is an in-tree NFA executor that runs in O(pattern * subject) time whatever the input.
+ * Patterns that need backtracking-only features (backreferences, lookaround) fall back to std::regex.
+ * Matches agree with std::regex, but captures can differ inside a quantified group whose body may match the empty
+ * string, e.g. (a*)* or ^(a*?(?:.*?)(.)?)*c: like JavaScript, the NFA never records an iteration that matched the
+ * empty string, while libstdc++ can end on one and report "" where the NFA keeps an earlier capture or none.
+ * check/regex_differential.cpp compares the two engines over a pattern corpus.
+ */
+class Regex
+{
+  public:
+    enum class Engine
+    {
+        Automatic,
+        Nfa,
+        Std
+    };
+
+    explicit Regex(const std::string &pattern, Engine engine = Engine::Automatic);
+
+    bool match(std::string_view subject) const
+    {
+        return backend_->match(subject, nullptr);
+    }
+    bool match(std::string_view subject, RegexMatch &match) const
+    {
+        return backend_->match(subject, &match);
+    }
+    bool search(std::string_view subject, size_t start, RegexMatch &match) const
+    {
+        return backend_->search(subject, start, &match);
+    }
+
+    /**
+     * @brief Replaces every match like std::regex_replace: $&, $n, $nn, $`, $' and $$ are expanded in `format`.
+     */
+    std::string replace(std::string_view subject, std::string_view format) const;
+
+    /**
+     * @brief Appends `subject` to `out` with every match replaced by the precompiled `format`, whose dynamic
+     * segments take their values from `dynamic`.
+     */
+    void replace(std::string &out, std::string_view subject, const RegexFormat &format,
+                 std::span<const std::string> dynamic = {}) const;
+
+    /**
+     * @brief Appends `format` with its $-references expanded against `match`. $` starts at `prefix_begin`, the end
+     * of the previous match when replacing repeatedly.
+     */
+    static void append_format(std::string &out, const RegexMatch &match, std::string_view format,
+                              size_t prefix_begin = 0)
+    {
+        RegexFormat(format).append(out, match, prefix_begin);
+    }
+
+    size_t group_count() const
+    {
+        return backend_->group_count();
+    }
+    bool linear_time() const
+    {
+        return backend_->linear_time();
+    }
+    const std::string &pattern() const
+    {
+        return pattern_;
+    }
+
+  private:
+    std::string pattern_;
+    std::shared_ptr<const RegexBackend> backend_;
+};
+
+/**
+ * @brief Several patterns matched against one subject in a single pass. The patterns are merged into one automaton
+ * whose states record which of them are still alive, so the cost per byte does not grow with the number of patterns.
+ * Only whole-subject matches (regex_match semantics) are reported, and no captures are kept.
+ */
+class RegexSet
+{
+  public:
+    /**
+     * @brief Whether `pattern` can be merged into a set. Patterns needing word boundaries or the std::regex fallback
+     * cannot, and should be matched on their own.
+     */
+    static bool supports(const std::string &pattern);
+
+    /** @throws RegexError if a pattern is invalid or not supported(). */
+    explicit RegexSet(const std::vector<std::string> &patterns);
+
+    /**
+     * @brief Matches every pattern against `subject`. Bit i of `matched` (64 per word) is set when pattern i matches.
+     */
+    void match(std::string_view subject, std::vector<uint64_t> &matched) const;
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+  private:
+    struct Automaton;
+
+    size_t size_ = 0;
+    std::shared_ptr<const Automaton> automaton_;
+};
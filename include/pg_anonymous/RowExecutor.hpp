@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Kernels.hpp"
+#include "Rules.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// --- Row Execution ---
+
+/**
+ * @brief A rule that threw while transforming a row, rethrown with the column it was evaluating and the row's
+ * ordinal in its COPY block.
+ */
+class RowError : public std::runtime_error
+{
+    size_t column_;
+    uint64_t ordinal_;
+
+  public:
+    RowError(size_t column, uint64_t ordinal, const std::string &message)
+        : std::runtime_error(message), column_(column), ordinal_(ordinal)
+    {
+    }
+    size_t column() const
+    {
+        return column_;
+    }
+    uint64_t ordinal() const
+    {
+        return ordinal_;
+    }
+};
+
+/**
+ * @brief Transforms a COPY block's data rows one at a time: splits the row into views over the original line, runs
+ * each column's rule on them and joins the results.
+ */
+class RowExecutor
+{
+  public:
+    RowExecutor();
+
+    /**
+     * @brief Starts a COPY block. The slots, indices, rules and execution context must stay alive until the next one.
+     */
+    void begin(const RowSlots &slots, const std::vector<size_t> &slot_indices,
+               const std::vector<const IRule *> &column_rules, ExecutionContext &execution);
+
+    /**
+     * @brief Appends the transformed row, the block's `ordinal`-th, and its newline to `out`.
+     * @throws RowError if a rule throws.
+     */
+    void transform(std::string_view line, uint64_t ordinal, std::string &out);
+
+  private:
+    static constexpr size_t kTabBatch = 64;
+
+    const RowSlots *slots_ = nullptr;
+    const std::vector<size_t> *slot_indices_ = nullptr;
+    const std::vector<const IRule *> *column_rules_ = nullptr;
+    ExecutionContext *execution_ = nullptr;
+    FindTabsKernel find_tabs_;
+    RowCache cache_;
+    std::vector<std::string_view> row_values_;
+    size_t tab_offsets_[kTabBatch];
+};
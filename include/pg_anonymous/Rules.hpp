@@ -1,334 +1,1971 @@
 #pragma once
 
+#include "Crypto.hpp"
+#include "Dates.hpp"
+#include "Dictionary.hpp"
+#include "Hash.hpp"
+#include "MemoCache.hpp"
+#include "Numeric.hpp"
+#include "Random.hpp"
+#include "Regex.hpp"
+
 #include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <optional>
 #include <random>
-#include <regex>
+#include <span>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_set>
+#include <variant>
 #include <vector>
 
 // --- Context Definition ---
 
+/**
+ * @brief A regex evaluated against a source column, shared by every rule that tests the same pattern against
+ * the same column so it runs at most once per row.
+ */
+struct MatchSlot
+{
+    size_t column_slot;
+    std::string pattern;
+    Regex regex;
+    bool needs_captures = false;
+    size_t set = static_cast<size_t>(-1); // the MatchSetSlot answering this slot, if any
+    size_t set_bit = 0;
+};
+
+/**
+ * @brief Capture-free match slots on one column merged into a single automaton, run once per row for all of them.
+ */
+struct MatchSetSlot
+{
+    size_t column_slot;
+    RegexSet regexes;
+};
+
+/**
+ * @brief Interns the per-row values referenced by a table's templates into dense slots: the source columns and
+ * the regex matches derived from them.
+ * Column slots are resolved against the COPY header once per block, so rules never search by name per row.
+ */
+class RowSlots
+{
+    std::vector<std::string> column_names_;
+    std::vector<MatchSlot> matches_;
+    std::vector<MatchSetSlot> match_sets_;
+
+  public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    size_t intern_column(const std::string &name)
+    {
+        auto it = std::find(column_names_.begin(), column_names_.end(), name);
+        if (it != column_names_.end())
+            return std::distance(column_names_.begin(), it);
+        column_names_.push_back(name);
+        return column_names_.size() - 1;
+    }
+
+    /**
+     * @brief Returns the shared slot for (column, pattern), compiling the pattern on first use.
+     * `needs_captures` marks slots whose groups are read; only the others can join a match set.
+     * @throws RegexError if the pattern is invalid.
+     */
+    size_t intern_match(size_t column_slot, const std::string &pattern, bool needs_captures)
+    {
+        for (size_t slot = 0; slot < matches_.size(); ++slot)
+        {
+            if (matches_[slot].column_slot == column_slot && matches_[slot].pattern == pattern)
+            {
+                matches_[slot].needs_captures |= needs_captures;
+                return slot;
+            }
+        }
+        matches_.push_back(MatchSlot{column_slot, pattern, Regex(pattern), needs_captures});
+        return matches_.size() - 1;
+    }
+
+    /**
+     * @brief Merges the capture-free match slots of each column into one RegexSet once every template of the table
+     * is compiled, so several matches() tests on a column cost a single pass over its value.
+     */
+    void build_match_sets()
+    {
+        match_sets_.clear();
+        for (auto &match : matches_)
+            match.set = npos;
+
+        for (size_t column_slot = 0; column_slot < column_names_.size(); ++column_slot)
+        {
+            std::vector<size_t> members;
+            for (size_t slot = 0; slot < matches_.size(); ++slot)
+            {
+                const MatchSlot &match = matches_[slot];
+                if (match.column_slot == column_slot && !match.needs_captures && RegexSet::supports(match.pattern))
+                    members.push_back(slot);
+            }
+            if (members.size() < 2)
+                continue;
+
+            std::vector<std::string> patterns;
+            for (size_t slot : members)
+                patterns.push_back(matches_[slot].pattern);
+            for (size_t bit = 0; bit < members.size(); ++bit)
+            {
+                matches_[members[bit]].set = match_sets_.size();
+                matches_[members[bit]].set_bit = bit;
+            }
+            match_sets_.push_back(MatchSetSlot{column_slot, RegexSet(patterns)});
+        }
+    }
+
+    const std::vector<std::string> &column_names() const
+    {
+        return column_names_;
+    }
+
+    const MatchSlot &match(size_t slot) const
+    {
+        return matches_[slot];
+    }
+
+    size_t match_count() const
+    {
+        return matches_.size();
+    }
+
+    const MatchSetSlot &match_set(size_t set) const
+    {
+        return match_sets_[set];
+    }
+
+    size_t match_set_count() const
+    {
+        return match_sets_.size();
+    }
+
+    /**
+     * @brief Maps every column slot to its position in the COPY column list (npos when absent).
+     * Unknown columns are reported here, once per COPY block, instead of silently yielding "" per row.
+     */
+    std::vector<size_t> bind(const std::vector<std::string> &columns, const std::string &table_name) const
+    {
+        std::vector<size_t> indices(column_names_.size(), npos);
+        for (size_t slot = 0; slot < column_names_.size(); ++slot)
+        {
+            auto it = std::find(columns.begin(), columns.end(), column_names_[slot]);
+            if (it != columns.end())
+                indices[slot] = std::distance(columns.begin(), it);
+            else
+                std::cerr << "Warning: Column '" << column_names_[slot] << "' referenced by rules of " << table_name
+                          << " is not present in its COPY header\n";
+        }
+        return indices;
+    }
+};
+
+/**
+ * @brief Row-scoped storage for shared match slots and match sets. Advancing the row stamp invalidates every slot
+ * at once.
+ */
+struct RowCache
+{
+    uint64_t row = 1;
+    std::vector<uint64_t> stamps;
+    std::vector<char> matched;
+    std::vector<RegexMatch> results;
+    std::vector<uint64_t> set_stamps;
+    std::vector<std::vector<uint64_t>> set_results;
+
+    void next_row()
+    {
+        ++row;
+    }
+};
+
+/**
+ * @brief The per-thread state that compiled rules reserve slots in: a cache per memoized subtree and a string buffer
+ * per rule that keeps intermediate values. Rules hold only the slot index, so a compiled rule program is immutable
+ * and can be shared by threads.
+ */
+struct ExecutionLayout
+{
+    std::vector<size_t> memo_budgets;
+    size_t buffer_count = 0;
+
+    size_t add_memo_cache(size_t byte_budget)
+    {
+        memo_budgets.push_back(byte_budget);
+        return memo_budgets.size() - 1;
+    }
+    size_t add_buffer()
+    {
+        return buffer_count++;
+    }
+};
+
+/**
+ * @brief Everything rules mutate while evaluating, owned by one thread. None of it affects the output: random rules
+ * are keyed by row ordinal, and caches and buffers only hold values derived from the row.
+ */
+struct ExecutionContext
+{
+    std::vector<MemoCache> memo_caches;
+    std::vector<std::vector<std::string>> buffers; // per reserving rule
+    std::vector<std::string_view> views;           // batch scratch, not held across nested rule calls
+    std::vector<uint64_t> hashes;
+
+    ExecutionContext() = default;
+    explicit ExecutionContext(const ExecutionLayout &layout) : buffers(layout.buffer_count)
+    {
+        memo_caches.reserve(layout.memo_budgets.size());
+        for (size_t byte_budget : layout.memo_budgets)
+            memo_caches.emplace_back(byte_budget);
+    }
+};
+
+/**
+ * @brief The field values of one row. Rows read line by line are a plain array; rows of a column-major batch are
+ * strided, one column array apart.
+ */
+struct RowValues
+{
+    const std::string_view *data = nullptr;
+    size_t count = 0;
+    size_t stride = 1;
+
+    RowValues(const std::vector<std::string_view> &values) : data(values.data()), count(values.size())
+    {
+    }
+    RowValues(const std::string_view *first, size_t count, size_t stride) : data(first), count(count), stride(stride)
+    {
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+    std::string_view operator[](size_t index) const
+    {
+        return data[index * stride];
+    }
+};
+
 struct RowContext
 {
-    const std::vector<std::string> &headers;
-    const std::vector<std::string> &row_values;
+    const RowSlots &slots;
+    const std::vector<size_t> &slot_indices;
+    RowValues row_values;
+    RowCache &cache;
+    ExecutionContext &execution;
+    uint64_t ordinal = 0; // the row's position in its COPY block; keys the random rules
+
+    std::string_view get_column_value(size_t slot) const
+    {
+        size_t index = slot_indices[slot];
+        if (index < row_values.size())
+            return row_values[index];
+        return {};
+    }
+
+    /**
+     * @brief Runs a match slot's regex over its column at most once per row.
+     * @return The match results, or nullptr when the column value does not match.
+     */
+    const RegexMatch *match(size_t match_slot) const
+    {
+        if (cache.stamps.size() < slots.match_count())
+        {
+            cache.stamps.resize(slots.match_count(), 0);
+            cache.matched.resize(slots.match_count(), 0);
+            cache.results.resize(slots.match_count());
+        }
+        if (cache.stamps[match_slot] != cache.row)
+        {
+            const MatchSlot &slot = slots.match(match_slot);
+            std::string_view value = get_column_value(slot.column_slot);
+            cache.matched[match_slot] = slot.regex.match(value, cache.results[match_slot]);
+            cache.stamps[match_slot] = cache.row;
+        }
+        return cache.matched[match_slot] ? &cache.results[match_slot] : nullptr;
+    }
+
+    /**
+     * @brief Whether a match slot's column value matches. Slots in a match set read their bit of the set's result,
+     * which is computed at most once per row.
+     */
+    bool matches(size_t match_slot) const
+    {
+        const MatchSlot &slot = slots.match(match_slot);
+        if (slot.set == RowSlots::npos)
+            return match(match_slot) != nullptr;
+
+        if (cache.set_stamps.size() < slots.match_set_count())
+        {
+            cache.set_stamps.resize(slots.match_set_count(), 0);
+            cache.set_results.resize(slots.match_set_count());
+        }
+        std::vector<uint64_t> &bits = cache.set_results[slot.set];
+        if (cache.set_stamps[slot.set] != cache.row)
+        {
+            const MatchSetSlot &set = slots.match_set(slot.set);
+            set.regexes.match(get_column_value(set.column_slot), bits);
+            cache.set_stamps[slot.set] = cache.row;
+        }
+        return (bits[slot.set_bit >> 6] >> (slot.set_bit & 63)) & 1;
+    }
+};
+
+// --- Abstract Base Class ---
+
+class IRule;
+class NoneRule;
+class StaticTextRule;
+class RandomIntRule;
+class PickRule;
+class PickFromCatalogRule;
+class RegexReplaceRule;
+class HashRule;
+class HmacRule;
+class FpeRule;
+class MaskEmailRule;
+class MaskPhoneRule;
+class MaskUrlRule;
+class MatchGroupRule;
+class MatchesRule;
+class DateShiftRule;
+class DateTruncRule;
+class AgeBucketRule;
+class NoiseRule;
+class RoundToRule;
+class BucketRule;
+class ConditionalRule;
+class CompositeRule;
+class MemoizedRule;
+class DictionaryRule;
+
+/**
+ * @brief Closed-set handle to a rule node. Compiled rules are immutable: evaluation goes through const handles and
+ * keeps all of its mutable state in the row's ExecutionContext.
+ * The built-in rules are final, so dispatching through std::visit lets the compiler devirtualize and inline
+ * them. IRule * stays as the open-ended alternative for rules outside the built-in set.
+ */
+using RuleRef =
+    std::variant<const NoneRule *, const StaticTextRule *, const RandomIntRule *, const PickRule *,
+                 const PickFromCatalogRule *, const RegexReplaceRule *, const HashRule *, const HmacRule *,
+                 const FpeRule *, const MaskEmailRule *, const MaskPhoneRule *, const MaskUrlRule *,
+                 const MatchGroupRule *, const MatchesRule *, const DateShiftRule *, const DateTruncRule *,
+                 const AgeBucketRule *, const NoiseRule *, const RoundToRule *, const BucketRule *,
+                 const ConditionalRule *, const CompositeRule *, const MemoizedRule *, const DictionaryRule *,
+                 const IRule *>;
+
+/**
+ * @brief What a rule's output may depend on. Rules with no dependencies are row-independent and are folded
+ * into static text once per run by RuleFactory::optimize.
+ */
+enum RuleDependency : unsigned
+{
+    DependsOnNothing = 0,
+    DependsOnValue = 1 << 0,
+    DependsOnColumns = 1 << 1,
+    DependsOnRandom = 1 << 2,
+    DependsOnEverything = DependsOnValue | DependsOnColumns | DependsOnRandom
+};
+
+using RuleRewriter = std::function<std::shared_ptr<IRule>(std::shared_ptr<IRule>)>;
+
+class IRule
+{
+  public:
+    virtual ~IRule() = default;
+    virtual std::string apply(const std::string &original_value, const RowContext &context) const = 0;
+    virtual RuleRef as_ref() const
+    {
+        return this;
+    }
+    virtual unsigned dependencies() const
+    {
+        return DependsOnEverything;
+    }
+    /**
+     * @brief Replaces every child rule with rewrite(child). Leaves have nothing to rewrite.
+     */
+    virtual void rewrite_children(const RuleRewriter &)
+    {
+    }
+};
+
+/**
+ * @brief Evaluates a rule through its closed-set handle.
+ * Defining PG_ANONYMOUS_VIRTUAL_DISPATCH falls back to plain virtual calls (used by the dispatch benchmark).
+ */
+inline std::string apply_rule(const RuleRef &rule, const std::string &original_value, const RowContext &context);
+inline void apply_rule_batch(const RuleRef &rule, std::span<const std::string_view> values,
+                             std::span<const RowContext> contexts, std::span<std::string> results);
+
+// --- Concrete Implementations ---
+
+class NoneRule final : public IRule
+{
+  public:
+    std::string apply(const std::string &original_value, const RowContext &) const override
+    {
+        return original_value;
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnValue;
+    }
+};
+
+class StaticTextRule final : public IRule
+{
+    std::string text_;
+
+  public:
+    explicit StaticTextRule(std::string text) : text_(std::move(text))
+    {
+    }
+    std::string apply(const std::string &, const RowContext &) const override
+    {
+        return text_;
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnNothing;
+    }
+    const std::string &text() const
+    {
+        return text_;
+    }
+};
+
+/**
+ * @brief Generates a random integer. Usage: {{rand(min, max)}}
+ */
+class RandomIntRule final : public IRule
+{
+    int min_;
+    uint64_t span_; // max - min + 1
+    CounterRng rng_;
+
+  public:
+    RandomIntRule(int min, int max, CounterRng rng)
+        : min_(std::min(min, max)), span_(static_cast<uint64_t>(int64_t(std::max(min, max)) - std::min(min, max)) + 1),
+          rng_(rng)
+    {
+    }
+    std::string apply(const std::string &, const RowContext &context) const override
+    {
+        return std::to_string(int64_t(min_) + static_cast<int64_t>(rng_.below(context.ordinal, span_)));
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnRandom;
+    }
+};
+
+/**
+ * @brief Selects a random option from a list. Usage: {{pick(A, B, C)}}
+ */
+class PickRule final : public IRule
+{
+    std::vector<std::string> options_;
+    CounterRng rng_;
+
+  public:
+    PickRule(std::vector<std::string> options, CounterRng rng) : options_(std::move(options)), rng_(rng)
+    {
+    }
+    std::string apply(const std::string &, const RowContext &context) const override
+    {
+        if (options_.empty())
+            return "";
+        return options_[rng_.below(context.ordinal, options_.size())];
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnRandom;
+    }
+};
+
+class PickFromCatalogRule final : public IRule
+{
+    const std::vector<std::string> *options_ = nullptr; // resolved once; the catalog is loaded before the rules
+    uint64_t key_seed_;
+    std::shared_ptr<IRule> identity_value_rule_;
+    RuleRef identity_value_ref_;
+    size_t buffer_; // the batch's identity values
+
+  public:
+    PickFromCatalogRule(const std::map<std::string, std::vector<std::string>> &catalog, std::string key,
+                        std::shared_ptr<IRule> identity_value_rule, size_t buffer)
+        : key_seed_(stable_hash::hash(key)), identity_value_rule_(identity_value_rule),
+          identity_value_ref_(identity_value_rule_->as_ref()), buffer_(buffer)
+    {
+        auto it = catalog.find(key);
+        if (it != catalog.end())
+            options_ = &it->second;
+    }
+    std::string apply(const std::string &original_value, const RowContext &context) const override
+    {
+        if (!options_ || options_->empty())
+            return "";
+
+        // Deterministic pick: the identity value hashed under the catalog key, reduced onto the options.
+        const std::string identity_value = apply_rule(identity_value_ref_, original_value, context);
+        return (*options_)[stable_hash::reduce(stable_hash::hash(identity_value, key_seed_), options_->size())];
+    }
+    /**
+     * @brief Column-batch form of apply(): evaluates the identity values for the whole batch, then hashes them
+     * together with stable_hash::hash_many.
+     */
+    void apply_batch(std::span<const std::string_view> values, std::span<const RowContext> contexts,
+                     std::span<std::string> results) const
+    {
+        if (!options_ || options_->empty())
+        {
+            for (auto &result : results)
+                result.clear();
+            return;
+        }
+        if (values.empty())
+            return;
+
+        const size_t count = values.size();
+        ExecutionContext &execution = contexts.front().execution;
+        std::vector<std::string> &identity_values = execution.buffers[buffer_];
+        identity_values.resize(count);
+        apply_rule_batch(identity_value_ref_, values, contexts, identity_values);
+        execution.views.assign(identity_values.begin(), identity_values.end());
+        execution.hashes.resize(count);
+        stable_hash::hash_many(execution.views.data(), count, key_seed_, execution.hashes.data());
+        for (size_t row = 0; row < count; ++row)
+            results[row] = (*options_)[stable_hash::reduce(execution.hashes[row], options_->size())];
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return identity_value_rule_->dependencies();
+    }
+    void rewrite_children(const RuleRewriter &rewrite) override
+    {
+        identity_value_rule_ = rewrite(identity_value_rule_);
+        identity_value_ref_ = identity_value_rule_->as_ref();
+    }
+};
+
+/**
+ * @brief Applies a Regex replacement to the ORIGINAL value.
+ * Usage: {{regex_replace(pattern, replacement)}}
+ * Static parts of the replacement are compiled once into a RegexFormat; dynamic parts are evaluated once per row.
+ */
+class RegexReplaceRule final : public IRule
+{
+    Regex pattern_;
+    std::shared_ptr<IRule> replacement_rule_;
+    RuleRef replacement_ref_;
+
+    RegexFormat format_;
+    std::vector<RuleRef> parts_; // replacement_rule_'s static and dynamic parts, in order
+    std::vector<RuleRef> dynamic_refs_;
+    size_t buffer_;           // the row's dynamic values
+    bool precompiled_ = true; // false when dynamic output may pair with a lone '$' before it
+
+  public:
+    RegexReplaceRule(const std::string &pattern, std::shared_ptr<IRule> replacement_rule, size_t buffer)
+        : pattern_(pattern), replacement_rule_(std::move(replacement_rule)),
+          replacement_ref_(replacement_rule_->as_ref()), buffer_(buffer)
+    {
+        compile_replacement();
+    }
+
+    std::string apply(const std::string &original_value, const RowContext &context) const override
+    {
+        std::vector<std::string> &dynamic_values = context.execution.buffers[buffer_];
+        dynamic_values.resize(dynamic_refs_.size());
+        bool expand = !precompiled_;
+        for (size_t i = 0; i < dynamic_refs_.size(); ++i)
+        {
+            dynamic_values[i] = apply_rule(dynamic_refs_[i], original_value, context);
+            expand = expand || dynamic_values[i].find('$') != std::string::npos;
+        }
+
+        std::string result;
+        if (expand)
+            // Dynamic output carrying $-references is expanded like the joined template always was.
+            pattern_.replace(result, original_value, RegexFormat(joined_replacement(dynamic_values)));
+        else
+            pattern_.replace(result, original_value, format_, dynamic_values);
+        return result;
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnValue | replacement_rule_->dependencies();
+    }
+    void rewrite_children(const RuleRewriter &rewrite) override
+    {
+        replacement_rule_ = rewrite(replacement_rule_);
+        replacement_ref_ = replacement_rule_->as_ref();
+        compile_replacement();
+    }
+
+  private:
+    inline void compile_replacement();
+    inline std::string joined_replacement(const std::vector<std::string> &dynamic_values) const;
+};
+
+/**
+ * @brief Hashes the value under a salt into a non-negative 31-bit decimal. Usage: {{hash(salt[, kernel])}}
+ * The default "fnv" kernel is the original byte-at-a-time FNV-1a, so values stay joinable with dumps anonymized by
+ * earlier versions; "stable" opts into stable_hash, which is faster and hashes batches in SIMD lanes but gives
+ * different values. Either way the salt is mixed in once, here.
+ */
+class HashRule final : public IRule
+{
+  public:
+    enum class Kernel
+    {
+        Stable,
+        Fnv1a
+    };
+
+  private:
+    Kernel kernel_;
+    uint64_t seed_; // the salted initial state of the kernel
+
+  public:
+    explicit HashRule(unsigned int salt, Kernel kernel = Kernel::Fnv1a) : kernel_(kernel)
+    {
+        const std::string salt_str = std::to_string(salt);
+        if (kernel_ == Kernel::Fnv1a)
+            seed_ = fnv1a(salt_str, 2166136261u);
+        else
+            seed_ = stable_hash::hash(salt_str);
+    }
+    std::string apply(const std::string &original_value, const RowContext &) const override
+    {
+        const uint32_t hash = kernel_ == Kernel::Fnv1a
+                                  ? fnv1a(original_value, static_cast<uint32_t>(seed_))
+                                  : static_cast<uint32_t>(stable_hash::hash(original_value, seed_) >> 32);
+
+        char digits[16];
+        auto result = std::to_chars(digits, digits + sizeof(digits), hash & 0x7FFFFFFF);
+        return std::string(digits, result.ptr);
+    }
+    /**
+     * @brief Column-batch form of apply(): the stable kernel hashes the whole column with stable_hash::hash_many.
+     */
+    void apply_batch(std::span<const std::string_view> values, std::span<const RowContext> contexts,
+                     std::span<std::string> results) const
+    {
+        if (values.empty())
+            return;
+
+        const size_t count = values.size();
+        std::vector<uint64_t> &hashes = contexts.front().execution.hashes;
+        hashes.resize(count);
+        if (kernel_ == Kernel::Fnv1a)
+        {
+            for (size_t row = 0; row < count; ++row)
+                hashes[row] = uint64_t(fnv1a(values[row], static_cast<uint32_t>(seed_))) << 32;
+        }
+        else
+        {
+            stable_hash::hash_many(values.data(), count, seed_, hashes.data());
+        }
+
+        char digits[16];
+        for (size_t row = 0; row < count; ++row)
+        {
+            auto result = std::to_chars(digits, digits + sizeof(digits), (hashes[row] >> 32) & 0x7FFFFFFF);
+            results[row].assign(digits, result.ptr);
+        }
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnValue;
+    }
+
+    static std::optional<Kernel> parse_kernel(const std::string &name)
+    {
+        if (name == "stable")
+            return Kernel::Stable;
+        if (name == "fnv")
+            return Kernel::Fnv1a;
+        return std::nullopt;
+    }
+
+  private:
+    static uint32_t fnv1a(std::string_view bytes, uint32_t hash)
+    {
+        for (char c : bytes)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+};
+
+/**
+ * @brief Keyed cryptographic pseudonym of the value. Usage: {{hmac(key, encoding[, length])}}
+ * Encodings: hex, base32, numeric; `length` truncates the output. The key may be "env:NAME" to read it from the
+ * environment. Unlike hash(), outputs cannot be brute-forced from low-entropy inputs without the key.
+ */
+class HmacRule final : public IRule
+{
+    std::shared_ptr<const HmacSha256> hmac_;
+    DigestEncoding encoding_;
+    size_t length_;
+
+  public:
+    HmacRule(const std::string &key, DigestEncoding encoding, size_t length)
+        : hmac_(std::make_shared<HmacSha256>(key)), encoding_(encoding), length_(length)
+    {
+    }
+    std::string apply(const std::string &original_value, const RowContext &) const override
+    {
+        const HmacSha256::Digest digest = hmac_->digest(original_value);
+        return encode_digest(digest.data(), digest.size(), encoding_, length_);
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnValue;
+    }
+};
+
+/**
+ * @brief Reversible, format-preserving encryption (NIST FF1). Usage: {{fpe(key, alphabet[, decrypt])}}
+ * Characters of the alphabet are encrypted as one numeral string; all other characters keep their place, so
+ * "555-1234" stays "ddd-dddd". FF1 is only secure over at least 10^6 values, so values with fewer alphabet
+ * characters than that takes (six digits, five lowercase letters, ...) are left unchanged.
+ * Alphabets: digits, lower, upper, alpha, alnum, hex, or the literal characters to use.
+ */
+class FpeRule final : public IRule
+{
+    std::shared_ptr<const Ff1Cipher> cipher_;
+    std::string alphabet_;
+    std::array<int16_t, 256> numeral_of_{}; // -1 for characters outside the alphabet
+    bool decrypt_;
+    size_t min_length_; // Ff1Cipher::min_length of the alphabet
+
+  public:
+    /** @throws CryptoError if the key or alphabet is unusable. */
+    FpeRule(const std::string &key, const std::string &alphabet, bool decrypt)
+        : cipher_(std::make_shared<Ff1Cipher>(key)), alphabet_(expand_alphabet(alphabet)), decrypt_(decrypt)
+    {
+        numeral_of_.fill(-1);
+        for (size_t i = 0; i < alphabet_.size(); ++i)
+        {
+            int16_t &numeral = numeral_of_[static_cast<unsigned char>(alphabet_[i])];
+            if (numeral >= 0)
+                throw CryptoError("alphabet repeats '" + std::string(1, alphabet_[i]) + "'");
+            numeral = static_cast<int16_t>(i);
+        }
+        if (alphabet_.size() < 2)
+            throw CryptoError("alphabet needs at least two characters");
+        min_length_ = Ff1Cipher::min_length(static_cast<unsigned>(alphabet_.size()));
+    }
+
+    size_t min_length() const
+    {
+        return min_length_;
+    }
+    std::string apply(const std::string &original_value, const RowContext &) const override
+    {
+        std::vector<uint16_t> numerals;
+        numerals.reserve(original_value.size());
+        for (char c : original_value)
+        {
+            if (numeral_of_[static_cast<unsigned char>(c)] >= 0)
+                numerals.push_back(static_cast<uint16_t>(numeral_of_[static_cast<unsigned char>(c)]));
+        }
+        if (numerals.size() < min_length_)
+            return original_value;
+
+        cipher_->transform(numerals, static_cast<unsigned>(alphabet_.size()), decrypt_);
+
+        std::string result = original_value;
+        size_t next = 0;
+        for (char &c : result)
+        {
+            if (numeral_of_[static_cast<unsigned char>(c)] >= 0)
+                c = alphabet_[numerals[next++]];
+        }
+        return result;
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnValue;
+    }
+
+  private:
+    static std::string expand_alphabet(const std::string &name)
+    {
+        static const std::string digits = "0123456789";
+        static const std::string lower = "abcdefghijklmnopqrstuvwxyz";
+        static const std::string upper = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+        if (name == "digits")
+            return digits;
+        if (name == "lower")
+            return lower;
+        if (name == "upper")
+            return upper;
+        if (name == "alpha")
+            return lower + upper;
+        if (name == "alnum")
+            return digits + lower + upper;
+        if (name == "hex")
+            return digits + "abcdef";
+        return name;
+    }
+};
+
+// The text COPY writes for NULL; the masking rules below leave it alone.
+constexpr std::string_view kCopyNull = "\\N";
+
+/**
+ * @brief Masks an email address in one scan, splitting it at the last '@'.
+ * Usage: {{mask_email([local][, domain][, salt=name])}}
+ * local: hash (default), mask (keeps the first character) or keep. hash replaces the local part with the hash of the
+ * whole address, domain included, exactly as {{hash(name)}} prints it for the same salt name (none by default).
+ * domain: keep_domain (default), keep_tld (masks all but the last label; a domain without a dot is masked entirely)
+ * or mask_domain. Values without an '@' are treated as a bare local part.
+ */
+class MaskEmailRule final : public IRule
+{
+  public:
+    enum class Local
+    {
+        Hash,
+        Mask,
+        Keep
+    };
+    enum class Domain
+    {
+        Keep,
+        KeepTld,
+        Mask
+    };
+
+  private:
+    Local local_;
+    Domain domain_;
+    HashRule hash_;
+
+  public:
+    MaskEmailRule(Local local, Domain domain, unsigned salt) : local_(local), domain_(domain), hash_(salt)
+    {
+    }
+    std::string apply(const std::string &original_value, const RowContext &context) const override
+    {
+        if (original_value == kCopyNull)
+            return original_value;
+
+        const size_t at = original_value.rfind('@');
+        const std::string_view local = std::string_view(original_value).substr(0, at);
+        std::string masked;
+        switch (local_)
+        {
+        case Local::Hash:
+            masked = hash_.apply(original_value, context);
+            break;
+        case Local::Mask:
+            masked.append(local.substr(0, 1));
+            masked.append(local.empty() ? 0 : local.size() - 1, '*');
+            break;
+        case Local::Keep:
+            masked.append(local);
+            break;
+        }
+        if (at == std::string::npos)
+            return masked;
+
+        masked += '@';
+        const size_t domain_start = masked.size();
+        masked.append(original_value, at + 1);
+        if (domain_ != Domain::Keep)
+        {
+            size_t end = masked.size();
+            if (domain_ == Domain::KeepTld)
+            {
+                const size_t dot = masked.rfind('.');
+                end = dot == std::string::npos || dot < domain_start ? masked.size() : dot;
+            }
+            for (size_t i = domain_start; i < end; ++i)
+            {
+                if (masked[i] != '.')
+                    masked[i] = '*';
+            }
+        }
+        return masked;
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnValue;
+    }
+
+    static std::optional<Local> parse_local(std::string_view name)
+    {
+        if (name.empty() || name == "hash")
+            return Local::Hash;
+        if (name == "mask")
+            return Local::Mask;
+        if (name == "keep")
+            return Local::Keep;
+        return std::nullopt;
+    }
+    static std::optional<Domain> parse_domain(std::string_view name)
+    {
+        if (name.empty() || name == "keep_domain")
+            return Domain::Keep;
+        if (name == "keep_tld")
+            return Domain::KeepTld;
+        if (name == "mask_domain")
+            return Domain::Mask;
+        return std::nullopt;
+    }
+};
+
+/**
+ * @brief Replaces every digit of a phone number but the last `keep_last` with '#'. Separators, spaces and a leading
+ * '+' keep their place, so "+1 555-123-4567" becomes "+# ###-###-4567". Usage: {{mask_phone([keep_last])}}, default 4.
+ */
+class MaskPhoneRule final : public IRule
+{
+    size_t keep_last_;
+
+  public:
+    explicit MaskPhoneRule(size_t keep_last) : keep_last_(keep_last)
+    {
+    }
+    std::string apply(const std::string &original_value, const RowContext &) const override
+    {
+        std::string masked = original_value;
+        size_t kept = 0;
+        for (size_t i = masked.size(); i-- > 0;)
+        {
+            if (masked[i] >= '0' && masked[i] <= '9' && kept++ >= keep_last_)
+                masked[i] = '#';
+        }
+        return masked;
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnValue;
+    }
+};
+
+/**
+ * @brief Reduces a URL to its scheme and host in one scan. Credentials are always dropped.
+ * Usage: {{mask_url([mode])}} with mode keep_host (default; "https://host:port") or keep_path (also keeps the path,
+ * dropping the query string and fragment, which is where tokens usually travel).
+ */
+class MaskUrlRule final : public IRule
+{
+    bool keep_path_;
+
+  public:
+    explicit MaskUrlRule(bool keep_path) : keep_path_(keep_path)
+    {
+    }
+    std::string apply(const std::string &original_value, const RowContext &) const override
+    {
+        if (original_value == kCopyNull)
+            return original_value;
+
+        const std::string_view url = original_value;
+        size_t pos = 0;
+        while (pos < url.size() && (std::isalnum(static_cast<unsigned char>(url[pos])) || url[pos] == '+' ||
+                                    url[pos] == '-' || url[pos] == '.'))
+            ++pos;
+        const size_t authority_start = url.substr(pos, 3) == "://" ? pos + 3 : 0;
+
+        size_t host_start = authority_start;
+        size_t end = authority_start;
+        for (; end < url.size() && url[end] != '/' && url[end] != '?' && url[end] != '#'; ++end)
+        {
+            if (url[end] == '@')
+                host_start = end + 1;
+        }
+        if (keep_path_)
+        {
+            while (end < url.size() && url[end] != '?' && url[end] != '#')
+                ++end;
+        }
+
+        std::string masked;
+        masked.reserve(end);
+        masked.append(url.substr(0, authority_start));
+        masked.append(url.substr(host_start, end - host_start));
+        return masked;
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnValue;
+    }
+};
+
+class MatchGroupRule final : public IRule
+{
+    size_t match_slot_;
+    int group_;
+
+  public:
+    MatchGroupRule(size_t match_slot, const std::string &group) : match_slot_(match_slot), group_(std::stoi(group))
+    {
+    }
+
+    std::string apply(const std::string &, const RowContext &context) const override
+    {
+        if (const RegexMatch *matches = context.match(match_slot_))
+        {
+            return std::string(matches->group(group_));
+        }
+
+        return "";
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnColumns;
+    }
+};
+
+/**
+ * @brief Checks if a target column's value matches a regex pattern.
+ * Usage: {{matches(column_name, pattern)}}. Returns "true" or "false".
+ */
+class MatchesRule final : public IRule
+{
+    size_t match_slot_;
+
+  public:
+    explicit MatchesRule(size_t match_slot) : match_slot_(match_slot)
+    {
+    }
+
+    std::string apply(const std::string &, const RowContext &context) const override
+    {
+        if (context.matches(match_slot_))
+        {
+            return "true";
+        }
+        return "false";
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnColumns;
+    }
+};
+
+/**
+ * @brief Moves a date or timestamp column by a random whole number of days in [-days, days].
+ * Usage: {{date_shift(column_name, days, seed)}}. Columns shifted with the same seed name draw from one stream per
+ * row, so they all move by the same offset and the intervals between a row's dates survive. The time of day and
+ * time zone are kept; values that do not parse (NULL, infinity, BC dates) are returned unchanged. Shifts that would
+ * leave the years 1 to 5874897 stop at the nearest end of that range rather than falling back to the original value.
+ */
+class DateShiftRule final : public IRule
+{
+    size_t column_slot_;
+    uint64_t span_; // 2 * days + 1
+    int64_t days_;
+    CounterRng rng_;
+
+  public:
+    DateShiftRule(size_t column_slot, int64_t days, CounterRng rng)
+        : column_slot_(column_slot), span_(static_cast<uint64_t>(days) * 2 + 1), days_(days), rng_(rng)
+    {
+    }
+    std::string apply(const std::string &, const RowContext &context) const override
+    {
+        std::string_view value = context.get_column_value(column_slot_);
+        PgDateTime date;
+        if (!PgDateTime::parse(value, date))
+            return std::string(value);
+
+        static const int64_t first_day = days_from_civil(1, 1, 1), last_day = days_from_civil(5874897, 12, 31);
+        date.days = std::clamp(date.days + static_cast<int64_t>(rng_.below(context.ordinal, span_)) - days_,
+                               first_day, last_day);
+        std::string shifted;
+        date.format(shifted); // always in range after the clamp
+        return shifted;
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnColumns | DependsOnRandom;
+    }
+};
+
+/**
+ * @brief Truncates a date or timestamp column, like PostgreSQL's date_trunc().
+ * Usage: {{date_trunc(column_name, unit)}} with unit one of year, quarter, month, week, day, hour, minute.
+ */
+class DateTruncRule final : public IRule
+{
+    size_t column_slot_;
+    DateUnit unit_;
+
+  public:
+    DateTruncRule(size_t column_slot, DateUnit unit) : column_slot_(column_slot), unit_(unit)
+    {
+    }
+    std::string apply(const std::string &, const RowContext &context) const override
+    {
+        std::string_view value = context.get_column_value(column_slot_);
+        PgDateTime date;
+        if (!PgDateTime::parse(value, date))
+            return std::string(value);
+
+        truncate_datetime(date, unit_);
+        std::string truncated;
+        if (!date.format(truncated))
+            return std::string(value);
+        return truncated;
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnColumns;
+    }
+};
+
+/**
+ * @brief Replaces a birth date with the age band it falls in as of a fixed reference date, e.g. "30-39".
+ * Usage: {{age_bucket(column_name, width, as_of)}}. The reference date is part of the template so that reruns
+ * produce the same bands. Dates after the reference count as age 0; unparsable values are returned unchanged.
+ */
+class AgeBucketRule final : public IRule
+{
+    size_t column_slot_;
+    int64_t width_;
+    int64_t reference_days_;
+
+  public:
+    AgeBucketRule(size_t column_slot, int64_t width, int64_t reference_days)
+        : column_slot_(column_slot), width_(width), reference_days_(reference_days)
+    {
+    }
+    std::string apply(const std::string &, const RowContext &context) const override
+    {
+        std::string_view value = context.get_column_value(column_slot_);
+        PgDateTime birth;
+        if (!PgDateTime::parse(value, birth))
+            return std::string(value);
+
+        const int64_t low = std::max<int64_t>(years_between(birth.days, reference_days_), 0) / width_ * width_;
+        if (width_ == 1)
+            return std::to_string(low);
+        return std::to_string(low) + "-" + std::to_string(low + width_ - 1);
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnColumns;
+    }
+};
+
+/**
+ * @brief Scales a numeric column by a random factor in [1 - pct/100, 1 + pct/100), drawn per row.
+ * Usage: {{noise(column_name, pct)}}. Integer and numeric values are perturbed exactly and keep their scale; float
+ * values in exponent notation go through double. Values that do not parse (NULL, NaN, Infinity) are returned
+ * unchanged.
+ */
+class NoiseRule final : public IRule
+{
+    size_t column_slot_;
+    double fraction_; // pct / 100
+    CounterRng rng_;
+
+  public:
+    NoiseRule(size_t column_slot, double pct, CounterRng rng)
+        : column_slot_(column_slot), fraction_(pct / 100), rng_(rng)
+    {
+    }
+    std::string apply(const std::string &, const RowContext &context) const override
+    {
+        std::string_view value = context.get_column_value(column_slot_);
+        const double factor = fraction_ * (2 * rng_.uniform(context.ordinal) - 1);
+        std::string noisy;
+        DecimalText decimal;
+        double real;
+        if (DecimalText::parse(value, decimal))
+        {
+            decimal.units += static_cast<__int128>(std::round(static_cast<long double>(decimal.units) * factor));
+            decimal.format(noisy);
+        }
+        else if (parse_float(value, real))
+            format_float(real + real * factor, noisy);
+        else
+            noisy = value;
+        return noisy;
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnColumns | DependsOnRandom;
+    }
+};
+
+/**
+ * @brief Rounds a numeric column to the nearest multiple of a step, halves away from zero.
+ * Usage: {{round_to(column_name, step)}}, e.g. round_to(salary, 1000) or round_to(lat, 0.01). The result keeps the
+ * value's scale, or the step's if that is finer.
+ */
+class RoundToRule final : public IRule
+{
+    size_t column_slot_;
+    DecimalText step_;
+    double real_step_;
+
+  public:
+    RoundToRule(size_t column_slot, DecimalText step)
+        : column_slot_(column_slot), step_(step), real_step_(static_cast<double>(step.to_long_double()))
+    {
+    }
+    std::string apply(const std::string &, const RowContext &context) const override
+    {
+        std::string_view value = context.get_column_value(column_slot_);
+        std::string rounded;
+        DecimalText decimal;
+        double real;
+        if (DecimalText::parse(value, decimal))
+        {
+            DecimalText step = step_;
+            const unsigned scale = std::max(decimal.scale, step.scale);
+            if (!decimal.rescale(scale) || !step.rescale(scale))
+                return std::string(value);
+            const __int128 remainder = decimal.units % step.units;
+            decimal.units -= remainder;
+            if (2 * (remainder < 0 ? -remainder : remainder) >= step.units)
+                decimal.units += remainder < 0 ? -step.units : step.units;
+            decimal.format(rounded);
+        }
+        else if (parse_float(value, real))
+            format_float(std::round(real / real_step_) * real_step_, rounded);
+        else
+            rounded = value;
+        return rounded;
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnColumns;
+    }
+};
+
+/**
+ * @brief Replaces a numeric column with the interval between ascending edges that contains it, in PostgreSQL's
+ * numrange text format. Usage: {{bucket(column_name, 0, 1000, 5000)}} gives "(,0)", "[0,1000)", "[1000,5000)" or
+ * "[5000,)". Values that do not parse are returned unchanged.
+ */
+class BucketRule final : public IRule
+{
+    size_t column_slot_;
+    std::vector<DecimalText> edges_;
+    std::vector<long double> real_edges_;
+    std::vector<std::string> labels_; // labels_[i]: values below edges_[i] and not below edges_[i - 1]
+
+  public:
+    BucketRule(size_t column_slot, const std::vector<std::string> &edges) : column_slot_(column_slot)
+    {
+        for (const std::string &text : edges)
+        {
+            DecimalText edge;
+            DecimalText::parse(text, edge);
+            edges_.push_back(edge);
+            real_edges_.push_back(edge.to_long_double());
+        }
+        labels_.push_back("(," + edges.front() + ")");
+        for (size_t i = 1; i < edges.size(); ++i)
+            labels_.push_back("[" + edges[i - 1] + "," + edges[i] + ")");
+        labels_.push_back("[" + edges.back() + ",)");
+    }
+
+    /** Whether `edges` are numbers in strictly ascending order. */
+    static bool valid_edges(std::span<const std::string> edges)
+    {
+        DecimalText previous, edge;
+        for (size_t i = 0; i < edges.size(); ++i)
+        {
+            if (!DecimalText::parse(edges[i], edge) || (i > 0 && compare_decimals(previous, edge) >= 0))
+                return false;
+            previous = edge;
+        }
+        return !edges.empty();
+    }
+
+    std::string apply(const std::string &, const RowContext &context) const override
+    {
+        std::string_view value = context.get_column_value(column_slot_);
+        DecimalText decimal;
+        double real;
+        size_t bucket;
+        if (DecimalText::parse(value, decimal))
+            bucket = std::upper_bound(edges_.begin(), edges_.end(), decimal,
+                                      [](const DecimalText &a, const DecimalText &b) {
+                                          return compare_decimals(a, b) < 0;
+                                      }) -
+                     edges_.begin();
+        else if (parse_float(value, real))
+            bucket = std::upper_bound(real_edges_.begin(), real_edges_.end(), real) - real_edges_.begin();
+        else
+            return std::string(value);
+        return labels_[bucket];
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnColumns;
+    }
+};
+
+/**
+ * @brief Chooses between two templates. Usage: {{if(check, op, value, then, else)}}
+ * Operators: eq, neq, in (comma list), lt, gt, between (inclusive "lo, hi"). List values may be wrapped in
+ * parentheses so their commas survive argument splitting, e.g. in, (a, b, c).
+ * The operator and its operands are parsed once, at construction.
+ */
+class ConditionalRule final : public IRule
+{
+    enum class Op
+    {
+        Equal,
+        NotEqual,
+        In,
+        LessThan,
+        GreaterThan,
+        Between,
+        Invalid
+    };
+
+    // Lists up to this size are scanned linearly, which beats hashing for the short lists typical in configs.
+    static constexpr size_t kLinearInLimit = 8;
+
+    struct StringHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view value) const
+        {
+            return std::hash<std::string_view>{}(value);
+        }
+    };
+
+    std::shared_ptr<IRule> condition_check_rule_;
+    Op op_;
+    std::string target_val_;
+    std::vector<std::string> in_options_;
+    std::unordered_set<std::string, StringHash, std::equal_to<>> in_set_;
+    double low_ = 0, high_ = 0;
+    std::shared_ptr<IRule> true_rule_;
+    std::shared_ptr<IRule> false_rule_;
+    RuleRef condition_check_ref_, true_ref_, false_ref_;
+
+  public:
+    ConditionalRule(std::shared_ptr<IRule> cond_rule, const std::string &op, std::string val,
+                    std::shared_ptr<IRule> t_rule, std::shared_ptr<IRule> f_rule)
+        : condition_check_rule_(std::move(cond_rule)), op_(parse_op(op)), target_val_(std::move(val)),
+          true_rule_(std::move(t_rule)), false_rule_(std::move(f_rule)),
+          condition_check_ref_(condition_check_rule_->as_ref()), true_ref_(true_rule_->as_ref()),
+          false_ref_(false_rule_->as_ref())
+    {
+        if (op_ == Op::In)
+        {
+            in_options_ = split_list(target_val_);
+            if (in_options_.size() > kLinearInLimit)
+                in_set_.insert(in_options_.begin(), in_options_.end());
+        }
+        else if (op_ == Op::LessThan || op_ == Op::GreaterThan)
+        {
+            if (!parse_number(trim(target_val_), low_))
+                invalidate(op, "a number");
+            high_ = low_;
+        }
+        else if (op_ == Op::Between)
+        {
+            std::vector<std::string> bounds = split_list(target_val_);
+            if (bounds.size() != 2 || !parse_number(bounds[0], low_) || !parse_number(bounds[1], high_))
+                invalidate(op, "two numbers");
+        }
+        else if (op_ == Op::Invalid)
+        {
+            std::cerr << "Warning: Unknown if() operator '" << op << "', condition is always false\n";
+        }
+    }
+
+    std::string apply(const std::string &original_value, const RowContext &context) const override
+    {
+        if (test(apply_rule(condition_check_ref_, original_value, context)))
+            return apply_rule(true_ref_, original_value, context);
+        return apply_rule(false_ref_, original_value, context);
+    }
+
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return condition_check_rule_->dependencies() | true_rule_->dependencies() | false_rule_->dependencies();
+    }
+    void rewrite_children(const RuleRewriter &rewrite) override
+    {
+        condition_check_rule_ = rewrite(condition_check_rule_);
+        true_rule_ = rewrite(true_rule_);
+        false_rule_ = rewrite(false_rule_);
+        condition_check_ref_ = condition_check_rule_->as_ref();
+        true_ref_ = true_rule_->as_ref();
+        false_ref_ = false_rule_->as_ref();
+    }
 
-    std::string get_column_value(const std::string &col_name) const
+    /**
+     * @brief Returns the branch selected by a row-independent condition, or nullptr if it varies per row.
+     */
+    std::shared_ptr<IRule> constant_branch(const RowContext &context) const
     {
-        auto it = std::find(headers.begin(), headers.end(), col_name);
-        if (it != headers.end())
-        {
-            size_t index = std::distance(headers.begin(), it);
-            if (index < row_values.size())
-            {
-                return row_values[index];
-            }
-        }
-        return "";
+        if (condition_check_rule_->dependencies() != DependsOnNothing)
+            return nullptr;
+        return test(apply_rule(condition_check_ref_, "", context)) ? true_rule_ : false_rule_;
     }
-};
 
-// --- Abstract Base Class ---
-
-class IRule
-{
-  public:
-    virtual ~IRule() = default;
-    virtual std::string apply(const std::string &original_value, const RowContext &context) = 0;
-};
+  private:
+    bool test(const std::string &actual_val) const
+    {
+        double number;
 
-// --- Concrete Implementations ---
+        switch (op_)
+        {
+        case Op::Equal:
+            return actual_val == target_val_;
+        case Op::NotEqual:
+            return actual_val != target_val_;
+        case Op::In:
+            if (!in_set_.empty())
+                return in_set_.contains(std::string_view(actual_val));
+            return std::find(in_options_.begin(), in_options_.end(), actual_val) != in_options_.end();
+        case Op::LessThan:
+            return parse_number(actual_val, number) && number < low_;
+        case Op::GreaterThan:
+            return parse_number(actual_val, number) && number > low_;
+        case Op::Between:
+            return parse_number(actual_val, number) && number >= low_ && number <= high_;
+        case Op::Invalid:
+            break;
+        }
+        return false;
+    }
 
-class NoneRule : public IRule
-{
-    std::string apply(const std::string &original_value, const RowContext &context)
+    static Op parse_op(const std::string &op)
     {
-        return original_value;
+        if (op == "eq")
+            return Op::Equal;
+        if (op == "neq")
+            return Op::NotEqual;
+        if (op == "in")
+            return Op::In;
+        if (op == "lt")
+            return Op::LessThan;
+        if (op == "gt")
+            return Op::GreaterThan;
+        if (op == "between")
+            return Op::Between;
+        return Op::Invalid;
     }
-};
 
-class StaticTextRule : public IRule
-{
-    std::string text_;
-
-  public:
-    explicit StaticTextRule(std::string text) : text_(std::move(text))
+    void invalidate(const std::string &op, const char *expected)
     {
+        std::cerr << "Warning: if() operator '" << op << "' expects " << expected << ", got '" << target_val_
+                  << "'; condition is always false\n";
+        op_ = Op::Invalid;
     }
-    std::string apply(const std::string &, const RowContext &) override
+
+    /**
+     * @brief Splits a comma list, dropping one pair of enclosing parentheses and trimming every item.
+     */
+    static std::vector<std::string> split_list(const std::string &raw)
     {
-        return text_;
-    }
-};
+        std::string list = trim(raw);
+        if (list.size() >= 2 && list.front() == '(' && list.back() == ')')
+            list = list.substr(1, list.size() - 2);
 
-/**
- * @brief Generates a random integer. Usage: {{rand(min, max)}}
- */
-class RandomIntRule : public IRule
-{
-    int min_, max_;
-    std::mt19937 rng_;
+        std::vector<std::string> items;
+        std::stringstream ss(list);
+        std::string item;
+        while (std::getline(ss, item, ','))
+            items.push_back(trim(item));
+        return items;
+    }
 
-  public:
-    RandomIntRule(int min, int max) : min_(min), max_(max), rng_(std::random_device{}())
+    static bool parse_number(std::string_view text, double &number)
     {
+        const char *end = text.data() + text.size();
+        auto [ptr, ec] = std::from_chars(text.data(), end, number);
+        return ec == std::errc() && ptr == end && !text.empty();
     }
-    std::string apply(const std::string &, const RowContext &) override
+
+  public:
+    static std::string trim(const std::string &str)
     {
-        std::uniform_int_distribution<int> dist(min_, max_);
-        return std::to_string(dist(rng_));
+        size_t first = str.find_first_not_of(" \t");
+        if (std::string::npos == first)
+            return "";
+        size_t last = str.find_last_not_of(" \t");
+        return str.substr(first, (last - first + 1));
     }
 };
 
-/**
- * @brief Selects a random option from a list. Usage: {{pick(A, B, C)}}
- */
-class PickRule : public IRule
+class CompositeRule final : public IRule
 {
-    std::vector<std::string> options_;
-    std::mt19937 rng_;
+    std::vector<std::shared_ptr<IRule>> sub_rules_;
+    std::vector<RuleRef> sub_refs_;
 
   public:
-    explicit PickRule(std::vector<std::string> options) : options_(std::move(options)), rng_(std::random_device{}())
+    void add_rule(std::shared_ptr<IRule> rule)
     {
+        sub_refs_.push_back(rule->as_ref());
+        sub_rules_.push_back(std::move(rule));
     }
-    std::string apply(const std::string &, const RowContext &) override
+    std::string apply(const std::string &original_value, const RowContext &context) const override
     {
-        if (options_.empty())
-            return "";
-        std::uniform_int_distribution<size_t> dist(0, options_.size() - 1);
-        return options_[dist(rng_)];
+        std::string result;
+        for (const auto &rule : sub_refs_)
+            result += apply_rule(rule, original_value, context);
+        return result;
     }
-};
-
-class PickFromCatalogRule : public IRule
-{
-    const std::map<std::string, std::vector<std::string>> &catalog_;
-    std::string key_;
-    std::shared_ptr<IRule> identity_value_rule_;
-    std::hash<std::string> hash_function_;
-
-  public:
-    explicit PickFromCatalogRule(const std::map<std::string, std::vector<std::string>> &catalog, std::string key,
-                                 std::shared_ptr<IRule> identity_value_rule)
-        : catalog_(catalog), key_(key), identity_value_rule_(identity_value_rule)
+    RuleRef as_ref() const override
     {
+        return this;
     }
-    std::string apply(const std::string &original_value, const RowContext &context) override
+    unsigned dependencies() const override
     {
-        if (!catalog_.contains(key_))
-            return "";
+        unsigned deps = DependsOnNothing;
+        for (const auto &rule : sub_rules_)
+            deps |= rule->dependencies();
+        return deps;
+    }
 
-        const std::vector<std::string> &options = catalog_.at(key_);
+    /**
+     * @brief Rewrites the children, then splices nested composites in place and merges adjacent static text.
+     */
+    void rewrite_children(const RuleRewriter &rewrite) override
+    {
+        std::vector<std::shared_ptr<IRule>> rules;
+        for (const auto &rule : sub_rules_)
+        {
+            auto rewritten = rewrite(rule);
+            RuleRef ref = rewritten->as_ref();
+            if (auto *nested = std::get_if<const CompositeRule *>(&ref))
+                rules.insert(rules.end(), (*nested)->sub_rules_.begin(), (*nested)->sub_rules_.end());
+            else
+                rules.push_back(std::move(rewritten));
+        }
 
-        if (options.empty())
-            return "";
+        sub_rules_.clear();
+        sub_refs_.clear();
+        for (auto &rule : rules)
+        {
+            RuleRef ref = rule->as_ref();
+            auto *text = std::get_if<const StaticTextRule *>(&ref);
+            if (text && (*text)->text().empty())
+                continue;
 
-        // Create deterministic seed from key + identity
-        const std::string identity_value = identity_value_rule_->apply(original_value, context);
-        std::string seed_str = key_ + identity_value;
-        size_t seed = std::hash<std::string>{}(seed_str);
+            auto *previous = sub_refs_.empty() ? nullptr : std::get_if<const StaticTextRule *>(&sub_refs_.back());
+            if (text && previous)
+            {
+                sub_rules_.back() = std::make_shared<StaticTextRule>((*previous)->text() + (*text)->text());
+                sub_refs_.back() = sub_rules_.back()->as_ref();
+            }
+            else
+            {
+                add_rule(std::move(rule));
+            }
+        }
+    }
 
-        // Use a deterministic PRNG
-        std::mt19937_64 rng(seed);
-        std::uniform_int_distribution<size_t> dist(0, options.size() - 1);
+    const std::vector<RuleRef> &sub_refs() const
+    {
+        return sub_refs_;
+    }
 
-        return options.at(dist(rng));
+    /**
+     * @brief The composite's only child, which can replace the composite itself; nullptr otherwise.
+     */
+    std::shared_ptr<IRule> sole_rule() const
+    {
+        return sub_rules_.size() == 1 ? sub_rules_.front() : nullptr;
     }
 };
 
 /**
- * @brief Applies a Regex replacement to the ORIGINAL value.
- * Usage: {{regex_replace(pattern, replacement)}}
+ * @brief Caches the output of a rule that depends only on the value being anonymized, keyed by that value.
+ * Installed by RuleFactory::memoize on low-cardinality columns, where it skips recomputing the same answer.
  */
-class RegexReplaceRule : public IRule
+class MemoizedRule final : public IRule
 {
-    std::regex pattern_;
-    std::shared_ptr<IRule> replacement_rule_;
+    std::shared_ptr<IRule> rule_;
+    RuleRef ref_;
+    size_t cache_; // in ExecutionContext::memo_caches
 
   public:
-    RegexReplaceRule(const std::string &pattern, std::shared_ptr<IRule> replacement_rule)
-        : pattern_(pattern), replacement_rule_(std::move(replacement_rule))
+    MemoizedRule(std::shared_ptr<IRule> rule, size_t cache)
+        : rule_(std::move(rule)), ref_(rule_->as_ref()), cache_(cache)
     {
     }
-
-    std::string apply(const std::string &original_value, const RowContext &context) override
+    std::string apply(const std::string &original_value, const RowContext &context) const override
     {
-        std::string dynamic_replacement_template = replacement_rule_->apply(original_value, context);
+        MemoCache &cache = context.execution.memo_caches[cache_];
+        if (!cache.enabled())
+            return apply_rule(ref_, original_value, context);
 
-        return std::regex_replace(original_value, pattern_, dynamic_replacement_template);
-    }
-};
-
-class HashRule : public IRule
-{
-    unsigned int salt_;
+        const uint64_t hash = stable_hash::hash(original_value);
+        if (const std::string *cached = cache.find(original_value, hash))
+            return *cached;
 
-  public:
-    explicit HashRule(unsigned int salt) : salt_(salt)
+        std::string result = apply_rule(ref_, original_value, context);
+        cache.insert(original_value, hash, result);
+        return result;
+    }
+    RuleRef as_ref() const override
     {
+        return this;
     }
-    std::string apply(const std::string &original_value, const RowContext &) override
+    unsigned dependencies() const override
     {
-        uint32_t hash = 2166136261u;
-        std::string salt_str = std::to_string(salt_);
-        // Mix Salt
-        for (char c : salt_str)
-        {
-            hash ^= static_cast<unsigned char>(c);
-            hash *= 16777619u;
-        }
-        // Mix Value
-        for (char c : original_value)
-        {
-            hash ^= static_cast<unsigned char>(c);
-            hash *= 16777619u;
-        }
-        return std::to_string(hash & 0x7FFFFFFF);
+        return rule_->dependencies();
+    }
+    void rewrite_children(const RuleRewriter &rewrite) override
+    {
+        rule_ = rewrite(rule_);
+        ref_ = rule_->as_ref();
+    }
+    size_t cache() const
+    {
+        return cache_;
     }
 };
 
-class MatchGroupRule : public IRule
+/**
+ * @brief Gives each distinct value one pseudonym, shared by every template using the same dictionary.
+ * Usage: {{dict(name, template)}}. The template is evaluated only the first time a value is seen, anywhere in the
+ * dump; e.g. {{dict(customers, {{rand(1, 999999)}})}} on customers.id and orders.customer_id keeps the keys joined.
+ * Random rules in the template are keyed by the value instead of the row, so a pseudonym does not depend on which
+ * row, or which thread, saw the value first (unless the template also reads other columns). Each dictionary has
+ * one lock, so with --threads the dict() calls on one dictionary run one at a time.
+ */
+class DictionaryRule final : public IRule
 {
-    std::string target_col_;
-    std::regex pattern_;
-    int group_;
-    std::smatch matches_;
+    std::shared_ptr<PseudonymDictionary> dictionary_;
+    std::shared_ptr<IRule> value_rule_;
+    RuleRef value_ref_;
 
   public:
-    MatchGroupRule(std::string col, const std::string &pattern, const std::string &group)
-        : target_col_(std::move(col)), pattern_(pattern), group_(std::stoi(group))
+    DictionaryRule(std::shared_ptr<PseudonymDictionary> dictionary, std::shared_ptr<IRule> value_rule)
+        : dictionary_(std::move(dictionary)), value_rule_(std::move(value_rule)), value_ref_(value_rule_->as_ref())
     {
     }
-
-    std::string apply(const std::string &, const RowContext &context) override
+    std::string apply(const std::string &original_value, const RowContext &context) const override
     {
-        std::string actual_val = context.get_column_value(target_col_);
-
-        if (std::regex_match(actual_val, matches_, pattern_))
-        {
-            return matches_[group_].str();
-        }
+        std::string pseudonym;
+        if (dictionary_->find(original_value, pseudonym))
+            return pseudonym;
 
-        return "";
+        RowContext value_context = context;
+        value_context.ordinal = stable_hash::hash(original_value);
+        pseudonym = apply_rule(value_ref_, original_value, value_context);
+        dictionary_->insert(original_value, pseudonym);
+        return pseudonym; // another thread's, if it recorded this value first
+    }
+    RuleRef as_ref() const override
+    {
+        return this;
+    }
+    unsigned dependencies() const override
+    {
+        return DependsOnValue | value_rule_->dependencies();
+    }
+    void rewrite_children(const RuleRewriter &rewrite) override
+    {
+        value_rule_ = rewrite(value_rule_);
+        value_ref_ = value_rule_->as_ref();
     }
 };
 
 /**
- * @brief Checks if a target column's value matches a regex pattern.
- * Usage: {{matches(column_name, pattern)}}. Returns "true" or "false".
+ * @brief Splits the replacement into static text, compiled here, and dynamic sub-rules evaluated per row.
  */
-class MatchesRule : public IRule
+inline void RegexReplaceRule::compile_replacement()
 {
-    std::string target_col_;
-    std::regex pattern_;
+    format_ = RegexFormat();
+    dynamic_refs_.clear();
+    precompiled_ = true;
 
-  public:
-    MatchesRule(std::string col, const std::string &pattern) : target_col_(std::move(col)), pattern_(pattern)
-    {
-    }
+    parts_ = {replacement_ref_};
+    if (auto *composite = std::get_if<const CompositeRule *>(&replacement_ref_))
+        parts_ = (*composite)->sub_refs();
 
-    std::string apply(const std::string &, const RowContext &context) override
+    std::string text_run; // adjacent static parts are parsed together, so "$" then "1" still reads as $1
+    for (const RuleRef &part : parts_)
     {
-        std::string actual_val = context.get_column_value(target_col_);
-        if (std::regex_match(actual_val, pattern_))
+        if (auto *text = std::get_if<const StaticTextRule *>(&part))
         {
-            return "true";
+            text_run += (*text)->text();
+            continue;
         }
-        return "false";
+        format_.add_format(text_run);
+        text_run.clear();
+        if (format_.dangling())
+            precompiled_ = false;
+        format_.add_dynamic();
+        dynamic_refs_.push_back(part);
     }
-};
+    format_.add_format(text_run);
+}
 
-class ConditionalRule : public IRule
+/**
+ * @brief The replacement template's output for the current row, from the dynamic values already computed.
+ */
+inline std::string RegexReplaceRule::joined_replacement(const std::vector<std::string> &dynamic_values) const
 {
-    std::shared_ptr<IRule> condition_check_rule_;
-    std::string op_;
-    std::string target_val_;
-    std::shared_ptr<IRule> true_rule_;
-    std::shared_ptr<IRule> false_rule_;
-
-  public:
-    ConditionalRule(std::shared_ptr<IRule> cond_rule, std::string op, std::string val, std::shared_ptr<IRule> t_rule,
-                    std::shared_ptr<IRule> f_rule)
-        : condition_check_rule_(std::move(cond_rule)), op_(std::move(op)), target_val_(std::move(val)),
-          true_rule_(std::move(t_rule)), false_rule_(std::move(f_rule))
+    std::string joined;
+    size_t dynamic = 0;
+    for (const RuleRef &part : parts_)
     {
+        if (auto *text = std::get_if<const StaticTextRule *>(&part))
+            joined += (*text)->text();
+        else
+            joined += dynamic_values[dynamic++];
     }
+    return joined;
+}
 
-    std::string apply(const std::string &original_value, const RowContext &context) override
-    {
-        std::string actual_val = condition_check_rule_->apply(original_value, context);
-        bool match = false;
+inline std::string apply_rule(const RuleRef &rule, const std::string &original_value, const RowContext &context)
+{
+#ifdef PG_ANONYMOUS_VIRTUAL_DISPATCH
+    return std::visit([](auto *node) -> const IRule * { return node; }, rule)->apply(original_value, context);
+#else
+    return std::visit([&](auto *node) { return node->apply(original_value, context); }, rule);
+#endif
+}
 
-        if (op_ == "eq")
-        {
-            match = (actual_val == target_val_);
-        }
-        else if (op_ == "neq")
-        {
-            match = (actual_val != target_val_);
-        }
-        else if (op_ == "in")
-        {
-            std::string args = target_val_;
-            std::stringstream ss(args);
-            std::string arg;
-            while (std::getline(ss, arg, ','))
+/**
+ * @brief Evaluates a rule over one column of a batch: results[i] = rule(values[i], contexts[i]).
+ * The handle is visited once for the whole column instead of once per row, so the loop runs on the concrete rule;
+ * rules with an apply_batch() member (hash, pick_from_catalog) process the column in one call. All contexts of a
+ * batch must share one ExecutionContext.
+ */
+inline void apply_rule_batch(const RuleRef &rule, std::span<const std::string_view> values,
+                             std::span<const RowContext> contexts, std::span<std::string> results)
+{
+    std::string value;
+#ifdef PG_ANONYMOUS_VIRTUAL_DISPATCH
+    const IRule *node = std::visit([](auto *node) -> const IRule * { return node; }, rule);
+    for (size_t row = 0; row < values.size(); ++row)
+    {
+        value.assign(values[row]);
+        results[row] = node->apply(value, contexts[row]);
+    }
+#else
+    std::visit(
+        [&](auto *node) {
+            if constexpr (requires { node->apply_batch(values, contexts, results); })
+            {
+                node->apply_batch(values, contexts, results);
+            }
+            else
             {
-                if (trim(arg) == actual_val)
+                for (size_t row = 0; row < values.size(); ++row)
                 {
-                    match = true;
-                    break;
+                    value.assign(values[row]);
+                    results[row] = node->apply(value, contexts[row]);
                 }
             }
-        }
+        },
+        rule);
+#endif
+}
 
-        if (match)
-            return true_rule_->apply(original_value, context);
-        return false_rule_->apply(original_value, context);
-    }
+// --- Factory for Parsing ---
 
-    static std::string trim(const std::string &str)
+/**
+ * @brief Run-wide state that templates are compiled against: the random streams, the shared dictionaries and the
+ * layout of the per-thread ExecutionContext the compiled rules run with.
+ */
+struct RuleEnvironment
+{
+    RandomStreams streams;
+    PseudonymDictionaries dictionaries;
+    ExecutionLayout layout;
+
+    explicit RuleEnvironment(uint64_t seed, size_t dictionary_memory = 64 << 20)
+        : streams(seed), dictionaries(dictionary_memory)
     {
-        size_t first = str.find_first_not_of(" \t");
-        if (std::string::npos == first)
-            return "";
-        size_t last = str.find_last_not_of(" \t");
-        return str.substr(first, (last - first + 1));
     }
 };
 
-class CompositeRule : public IRule
+class RuleFactory
 {
-    std::vector<std::shared_ptr<IRule>> sub_rules_;
-
   public:
-    void add_rule(std::shared_ptr<IRule> rule)
+    /**
+     * @brief Parses a template and runs the optimization pass over the result.
+     */
+    static std::shared_ptr<IRule> compile_template(
+        const std::string &raw_template, const std::map<std::string, std::vector<std::string>> &replacement_catalog,
+        RowSlots &row_slots, RuleEnvironment &env)
     {
-        sub_rules_.push_back(std::move(rule));
+        return optimize(parse_template(raw_template, replacement_catalog, row_slots, env));
     }
-    std::string apply(const std::string &original_value, const RowContext &context) override
+
+    /**
+     * @brief Bottom-up simplification: folds row-independent subtrees into static text (computed once per run),
+     * selects the branch of conditionals with a constant condition, merges adjacent literals and unwraps
+     * single-child composites.
+     */
+    static std::shared_ptr<IRule> optimize(std::shared_ptr<IRule> rule)
     {
-        std::ostringstream result;
-        for (const auto &rule : sub_rules_)
-            result << rule->apply(original_value, context);
-        return result.str();
+        static const RowSlots no_slots;
+        static const std::vector<size_t> no_indices;
+        static const std::vector<std::string_view> no_values;
+        RowCache no_cache;
+        ExecutionContext no_execution; // folded subtrees are row-independent and reserve no state
+        const RowContext no_row{no_slots, no_indices, no_values, no_cache, no_execution};
+
+        rule->rewrite_children(optimize);
+        RuleRef ref = rule->as_ref();
+
+        if (std::holds_alternative<const StaticTextRule *>(ref))
+            return rule;
+        if (rule->dependencies() == DependsOnNothing)
+            return std::make_shared<StaticTextRule>(rule->apply("", no_row));
+
+        if (auto *conditional = std::get_if<const ConditionalRule *>(&ref))
+        {
+            if (auto branch = (*conditional)->constant_branch(no_row))
+                return branch;
+        }
+        else if (auto *composite = std::get_if<const CompositeRule *>(&ref))
+        {
+            if (auto only = (*composite)->sole_rule())
+                return only;
+        }
+        return rule;
     }
-};
 
-// --- Factory for Parsing ---
+    /**
+     * @brief Wraps every maximal subtree whose output depends only on the value in a MemoizedRule with its own
+     * `byte_budget` cache reserved in `layout`; created rules are appended to `caches` for reporting. Trivial rules
+     * are left alone, since a lookup would cost as much as recomputing them.
+     */
+    static std::shared_ptr<IRule> memoize(std::shared_ptr<IRule> rule, size_t byte_budget, ExecutionLayout &layout,
+                                          std::vector<std::shared_ptr<MemoizedRule>> &caches)
+    {
+        RuleRef ref = rule->as_ref();
+        if (std::holds_alternative<const NoneRule *>(ref) || std::holds_alternative<const HashRule *>(ref) ||
+            std::holds_alternative<const StaticTextRule *>(ref) || std::holds_alternative<const MemoizedRule *>(ref))
+            return rule;
+
+        if (rule->dependencies() == DependsOnValue)
+        {
+            auto memoized = std::make_shared<MemoizedRule>(std::move(rule), layout.add_memo_cache(byte_budget));
+            caches.push_back(memoized);
+            return memoized;
+        }
+
+        rule->rewrite_children(
+            [&](std::shared_ptr<IRule> child) { return memoize(child, byte_budget, layout, caches); });
+        return rule;
+    }
 
-class RuleFactory
-{
-  public:
     /**
      * @brief Parses template strings using a generic brace counter to support nesting.
      */
     static std::shared_ptr<IRule> parse_template(
-        const std::string &raw_template, const std::map<std::string, std::vector<std::string>> &replacement_catalog)
+        const std::string &raw_template, const std::map<std::string, std::vector<std::string>> &replacement_catalog,
+        RowSlots &row_slots, RuleEnvironment &env)
     {
         auto composite = std::make_shared<CompositeRule>();
         size_t len = raw_template.length();
@@ -362,7 +1999,7 @@ class RuleFactory
                     if (depth == 0)
                     {
                         std::string content = raw_template.substr(start_content, j - 1 - start_content);
-                        composite->add_rule(create_func_rule(content, replacement_catalog));
+                        composite->add_rule(create_func_rule(content, replacement_catalog, row_slots, env));
 
                         i = j + 1;
                         last_pos = i;
@@ -395,7 +2032,8 @@ class RuleFactory
 
   private:
     static std::shared_ptr<IRule> create_func_rule(
-        const std::string &func_def, const std::map<std::string, std::vector<std::string>> &replacement_catalog)
+        const std::string &func_def, const std::map<std::string, std::vector<std::string>> &replacement_catalog,
+        RowSlots &row_slots, RuleEnvironment &env)
     {
         // 1. Extract Name
         size_t paren_start = func_def.find('(');
@@ -425,32 +2063,114 @@ class RuleFactory
         {
             try
             {
-                return std::make_shared<RandomIntRule>(std::stoi(args[0]), std::stoi(args[1]));
+                return std::make_shared<RandomIntRule>(std::stoi(args[0]), std::stoi(args[1]),
+                                                       env.streams.next_stream());
             }
             catch (...)
             {
             }
         }
-        else if (name == "hash" && args.size() == 1)
+        else if (name == "hash" && (args.size() == 1 || (args.size() == 2 && HashRule::parse_kernel(args[1]))))
+        {
+            auto kernel = args.size() == 2 ? *HashRule::parse_kernel(args[1]) : HashRule::Kernel::Fnv1a;
+            return std::make_shared<HashRule>(hash_salt(args[0]), kernel);
+        }
+        else if (name == "hmac" && (args.size() == 2 || args.size() == 3) && parse_digest_encoding(args[1]))
+        {
+            size_t length = 0;
+            if (args.size() == 3)
+            {
+                auto [end, ec] = std::from_chars(args[2].data(), args[2].data() + args[2].size(), length);
+                if (ec != std::errc() || end != args[2].data() + args[2].size())
+                {
+                    std::cerr << "Warning: Invalid hmac() length " << args[2] << ", using the full digest\n";
+                    length = 0;
+                }
+            }
+            try
+            {
+                return std::make_shared<HmacRule>(resolve_key(args[0]), *parse_digest_encoding(args[1]), length);
+            }
+            catch (const CryptoError &e)
+            {
+                std::cerr << "Crypto Error in hmac(): " << e.what() << "\n";
+            }
+        }
+        else if (name == "fpe" && (args.size() == 2 || (args.size() == 3 && args[2] == "decrypt")))
+        {
+            try
+            {
+                auto rule = std::make_shared<FpeRule>(resolve_key(args[0]), args[1], args.size() == 3);
+                std::cerr << "Warning: fpe(" << args[1] << ") leaves values with fewer than " << rule->min_length()
+                          << " alphabet characters unchanged; FF1 needs a domain of at least 10^6 values\n";
+                return rule;
+            }
+            catch (const CryptoError &e)
+            {
+                std::cerr << "Crypto Error in fpe(): " << e.what() << "\n";
+            }
+        }
+        else if (name == "mask_email" && args.size() <= 3)
+        {
+            // local and domain are positional; salt= may appear anywhere.
+            std::vector<std::string_view> modes;
+            std::string_view salt_name;
+            for (const std::string &arg : args)
+            {
+                if (arg.starts_with("salt="))
+                    salt_name = option_value(arg, "salt");
+                else
+                    modes.push_back(arg);
+            }
+            auto local = MaskEmailRule::parse_local(modes.empty() ? "" : option_value(modes[0], "local"));
+            auto domain = MaskEmailRule::parse_domain(modes.size() < 2 ? "" : option_value(modes[1], "domain"));
+            if (local && domain && modes.size() <= 2)
+                return std::make_shared<MaskEmailRule>(*local, *domain, hash_salt(salt_name));
+            std::cerr << "Warning: Invalid mask_email() mode\n";
+        }
+        else if (name == "mask_phone" && args.size() == 1)
+        {
+            std::string_view count = option_value(args[0], "keep_last");
+            size_t keep_last = 4;
+            auto [end, ec] = std::from_chars(count.data(), count.data() + count.size(), keep_last);
+            if (count.empty() || (ec == std::errc() && end == count.data() + count.size()))
+                return std::make_shared<MaskPhoneRule>(count.empty() ? 4 : keep_last);
+            std::cerr << "Warning: Invalid mask_phone() digit count " << count << "\n";
+        }
+        else if (name == "mask_url" && args.size() == 1 &&
+                 (args[0].empty() || args[0] == "keep_host" || args[0] == "keep_path"))
         {
-            unsigned int salt = 0;
-            for (char c : args[0])
-                salt = (salt * 31) + (unsigned char)c;
-            return std::make_shared<HashRule>(salt);
+            return std::make_shared<MaskUrlRule>(args[0] == "keep_path");
+        }
+        else if (name == "dict" && args.size() == 2)
+        {
+            const RandomStreams::Position position = env.streams.position();
+            env.streams.enter_dictionary_scope(args[0]);
+            auto value_rule = parse_template(args[1], replacement_catalog, row_slots, env);
+            env.streams.restore(position);
+            return std::make_shared<DictionaryRule>(env.dictionaries.get(args[0]), value_rule);
         }
         else if (name == "pick")
         {
-            return std::make_shared<PickRule>(args);
+            return std::make_shared<PickRule>(args, env.streams.next_stream());
         }
         else if (name == "pick_from_catalog" && args.size() == 2)
         {
-            auto identity_value_rule = parse_template(args[1], replacement_catalog);
-            return std::make_shared<PickFromCatalogRule>(replacement_catalog, args[0], identity_value_rule);
+            auto identity_value_rule = parse_template(args[1], replacement_catalog, row_slots, env);
+            return std::make_shared<PickFromCatalogRule>(replacement_catalog, args[0], identity_value_rule,
+                                                         env.layout.add_buffer());
         }
         else if (name == "regex_replace" && args.size() >= 2)
         {
-            auto replacement_rule = parse_template(args[1], replacement_catalog);
-            return std::make_shared<RegexReplaceRule>(args[0], replacement_rule);
+            try
+            {
+                auto replacement_rule = parse_template(args[1], replacement_catalog, row_slots, env);
+                return std::make_shared<RegexReplaceRule>(args[0], replacement_rule, env.layout.add_buffer());
+            }
+            catch (const RegexError &e)
+            {
+                std::cerr << "Regex Error in regex_replace(): " << e.what() << " for pattern: " << args[0] << "\n";
+            }
         }
         else if (name == "literal" && !args.empty())
         {
@@ -460,9 +2180,10 @@ class RuleFactory
         {
             try
             {
-                return std::make_shared<MatchGroupRule>(args[0], args[1], args[2]);
+                return std::make_shared<MatchGroupRule>(
+                    row_slots.intern_match(row_slots.intern_column(args[0]), args[1], true), args[2]);
             }
-            catch (const std::regex_error &e)
+            catch (const RegexError &e)
             {
                 std::cerr << "Regex Error in match_group(): " << e.what() << " for pattern: " << args[1] << "\n";
             }
@@ -474,9 +2195,10 @@ class RuleFactory
         {
             try
             {
-                return std::make_shared<MatchesRule>(args[0], args[1]);
+                return std::make_shared<MatchesRule>(
+                    row_slots.intern_match(row_slots.intern_column(args[0]), args[1], false));
             }
-            catch (const std::regex_error &e)
+            catch (const RegexError &e)
             {
                 std::cerr << "Regex Error in matches(): " << e.what() << " for pattern: " << args[1] << "\n";
             }
@@ -484,11 +2206,60 @@ class RuleFactory
             {
             }
         }
+        else if (name == "date_shift" && args.size() == 3)
+        {
+            int64_t days = 0;
+            const char *first = args[1].data() + (args[1].starts_with('+') ? 1 : 0);
+            auto [end, ec] = std::from_chars(first, args[1].data() + args[1].size(), days);
+            if (ec == std::errc() && end == args[1].data() + args[1].size() && days >= -kPgDateSpanDays &&
+                days <= kPgDateSpanDays)
+                return std::make_shared<DateShiftRule>(row_slots.intern_column(args[0]), days < 0 ? -days : days,
+                                                       env.streams.shared_stream(args[2]));
+            std::cerr << "Warning: Invalid date_shift() day count " << args[1] << "\n";
+        }
+        else if (name == "date_trunc" && args.size() == 2)
+        {
+            if (auto unit = parse_date_unit(args[1]))
+                return std::make_shared<DateTruncRule>(row_slots.intern_column(args[0]), *unit);
+            std::cerr << "Warning: Unknown date_trunc() unit " << args[1] << "\n";
+        }
+        else if (name == "age_bucket" && args.size() == 3)
+        {
+            int64_t width = 0;
+            auto [end, ec] = std::from_chars(args[1].data(), args[1].data() + args[1].size(), width);
+            PgDateTime reference;
+            if (ec == std::errc() && end == args[1].data() + args[1].size() && width > 0 &&
+                PgDateTime::parse(args[2], reference))
+                return std::make_shared<AgeBucketRule>(row_slots.intern_column(args[0]), width, reference.days);
+            std::cerr << "Warning: Invalid age_bucket() width or reference date: " << args[1] << ", " << args[2]
+                      << "\n";
+        }
+        else if (name == "noise" && args.size() == 2)
+        {
+            double pct = 0;
+            if (parse_float(args[1], pct) && pct >= 0 && pct <= 100)
+                return std::make_shared<NoiseRule>(row_slots.intern_column(args[0]), pct, env.streams.next_stream());
+            std::cerr << "Warning: Invalid noise() percentage " << args[1] << ", expected 0 to 100\n";
+        }
+        else if (name == "round_to" && args.size() == 2)
+        {
+            DecimalText step;
+            if (DecimalText::parse(args[1], step) && step.units > 0)
+                return std::make_shared<RoundToRule>(row_slots.intern_column(args[0]), step);
+            std::cerr << "Warning: Invalid round_to() step " << args[1] << "\n";
+        }
+        else if (name == "bucket" && args.size() >= 2)
+        {
+            std::vector<std::string> edges(args.begin() + 1, args.end());
+            if (BucketRule::valid_edges(edges))
+                return std::make_shared<BucketRule>(row_slots.intern_column(args[0]), edges);
+            std::cerr << "Warning: bucket() edges must be ascending numbers\n";
+        }
         else if (name == "if" && args.size() == 5)
         {
-            auto condition_rule = parse_template(args[0], replacement_catalog);
-            auto true_rule = parse_template(args[3], replacement_catalog);
-            auto false_rule = parse_template(args[4], replacement_catalog);
+            auto condition_rule = parse_template(args[0], replacement_catalog, row_slots, env);
+            auto true_rule = parse_template(args[3], replacement_catalog, row_slots, env);
+            auto false_rule = parse_template(args[4], replacement_catalog, row_slots, env);
             return std::make_shared<ConditionalRule>(condition_rule, args[1], args[2], true_rule, false_rule);
         }
 
@@ -523,6 +2294,27 @@ class RuleFactory
         return args;
     }
 
+    /**
+     * @brief The salt {{hash(name)}} derives from its argument text.
+     */
+    static unsigned int hash_salt(std::string_view name)
+    {
+        unsigned int salt = 0;
+        for (char c : name)
+            salt = (salt * 31) + (unsigned char)c;
+        return salt;
+    }
+
+        /**
+     * @brief The value of an argument that may be written as "name=value".
+     */
+    static std::string_view option_value(std::string_view arg, std::string_view name)
+    {
+        if (arg.size() > name.size() && arg.starts_with(name) && arg[name.size()] == '=')
+            arg.remove_prefix(name.size() + 1);
+        return arg;
+    }
+
     static std::string trim(const std::string &str)
     {
         size_t first = str.find_first_not_of(" \t");
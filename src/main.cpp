@@ -1,12 +1,18 @@
 #include "pg_anonymous/DataProcessor.hpp"
+#include "pg_anonymous/Kernels.hpp"
 
+#include <algorithm>
+#include <charconv>
 #include <iostream>
 #include <map>
+#include <random>
 #include <string>
+#include <thread>
 
 // --- Function Prototypes ---
 void print_usage(const std::string &program_name);
 std::map<std::string, std::string> parse_arguments(int argc, char *argv[]);
+bool parse_size(const std::string &text, size_t &bytes);
 
 // --- Global Constants for Arguments ---
 const std::string CONFIG_FLAG = "--config";
@@ -15,6 +21,13 @@ const std::string INPUT_FLAG = "--input";
 const std::string INPUT_SHORT_FLAG = "-i";
 const std::string OUTPUT_FLAG = "--output";
 const std::string OUTPUT_SHORT_FLAG = "-o";
+const std::string SEED_FLAG = "--seed";
+const std::string SEED_SHORT_FLAG = "-s";
+const std::string CACHE_SIZE_FLAG = "--cache-size";
+const std::string DICT_MEMORY_FLAG = "--dict-memory";
+const std::string BATCH_ROWS_FLAG = "--batch-rows";
+const std::string KERNEL_FLAG = "--kernel";
+const std::string THREADS_FLAG = "--threads";
 const std::string HELP_FLAG = "--help";
 const std::string HELP_SHORT_FLAG = "-h";
 
@@ -34,6 +47,18 @@ void print_usage(const std::string &program_name)
               << "\t<file>  The input PostgreSQL dump file (dump.sql) (REQUIRED).\n";
     std::cerr << "  " << OUTPUT_SHORT_FLAG << ", " << OUTPUT_FLAG
               << "\t<file>  The output file for the sanitized dump (out.sql) (REQUIRED).\n";
+    std::cerr << "  " << SEED_SHORT_FLAG << ", " << SEED_FLAG
+              << "\t<n>     Seed for rand/pick, making runs reproducible (default: random, printed at start).\n";
+    std::cerr << "      " << CACHE_SIZE_FLAG
+              << "\t<size>  Memoize value-only rules, each cache holding up to <size> bytes (k/m/g suffixes allowed).\n";
+    std::cerr << "      " << DICT_MEMORY_FLAG
+              << "\t<size>  Memory per dict() dictionary before it spills to a temporary file (default: 64m).\n";
+    std::cerr << "      " << BATCH_ROWS_FLAG
+              << "\t<n>     Evaluate rules column by column over batches of <n> rows (default: 0, row by row).\n";
+    std::cerr << "      " << THREADS_FLAG
+              << "\t<n>     Evaluate rows on <n> threads, 0 for one per core; same output for any <n> (default: 1).\n";
+    std::cerr << "      " << KERNEL_FLAG
+              << "\t<level> SIMD kernels: auto, scalar, sse4.2, avx2, avx512 or neon (default: auto, detected).\n";
     std::cerr << "  " << HELP_SHORT_FLAG << ", " << HELP_FLAG << "\t\tShow this help message.\n";
     std::cerr << "\nExample: " << program_name << " -c config.yaml -i dump.sql -o out.sql\n";
 }
@@ -69,6 +94,18 @@ std::map<std::string, std::string> parse_arguments(int argc, char *argv[])
             canonical_flag = INPUT_FLAG;
         else if (arg == OUTPUT_FLAG || arg == OUTPUT_SHORT_FLAG)
             canonical_flag = OUTPUT_FLAG;
+        else if (arg == SEED_FLAG || arg == SEED_SHORT_FLAG)
+            canonical_flag = SEED_FLAG;
+        else if (arg == CACHE_SIZE_FLAG)
+            canonical_flag = CACHE_SIZE_FLAG;
+        else if (arg == DICT_MEMORY_FLAG)
+            canonical_flag = DICT_MEMORY_FLAG;
+        else if (arg == BATCH_ROWS_FLAG)
+            canonical_flag = BATCH_ROWS_FLAG;
+        else if (arg == KERNEL_FLAG)
+            canonical_flag = KERNEL_FLAG;
+        else if (arg == THREADS_FLAG)
+            canonical_flag = THREADS_FLAG;
         else
         {
             std::cerr << "Error: Unknown argument or misplaced value: " << arg << "\n";
@@ -93,6 +130,45 @@ std::map<std::string, std::string> parse_arguments(int argc, char *argv[])
     return args;
 }
 
+/**
+ * @brief Parses a byte count with an optional k, m or g suffix (powers of 1024).
+ * @return false if `text` is not a valid size.
+ */
+bool parse_size(const std::string &text, size_t &bytes)
+{
+    const char *end = text.data() + text.size();
+    auto [suffix, ec] = std::from_chars(text.data(), end, bytes);
+    if (ec != std::errc())
+        return false;
+    if (suffix == end)
+        return true;
+    if (suffix + 1 != end)
+        return false;
+
+    int shift = 0;
+    switch (*suffix)
+    {
+    case 'k':
+    case 'K':
+        shift = 10;
+        break;
+    case 'm':
+    case 'M':
+        shift = 20;
+        break;
+    case 'g':
+    case 'G':
+        shift = 30;
+        break;
+    default:
+        return false;
+    }
+    if (bytes > (SIZE_MAX >> shift))
+        return false;
+    bytes <<= shift;
+    return true;
+}
+
 int main(int argc, char *argv[])
 {
     std::map<std::string, std::string> params = parse_arguments(argc, argv);
@@ -124,13 +200,78 @@ int main(int argc, char *argv[])
     const std::string input_file = params.at(INPUT_FLAG);
     const std::string output_file = params.at(OUTPUT_FLAG);
 
+    ProcessorOptions options;
+    if (params.count(SEED_FLAG))
+    {
+        const std::string &raw_seed = params.at(SEED_FLAG);
+        auto [end, ec] = std::from_chars(raw_seed.data(), raw_seed.data() + raw_seed.size(), options.seed);
+        if (ec != std::errc() || end != raw_seed.data() + raw_seed.size())
+        {
+            std::cerr << "Error: Seed must be an unsigned 64-bit integer, got: " << raw_seed << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        std::random_device device;
+        options.seed = (uint64_t(device()) << 32) | device();
+    }
+
+    if (params.count(CACHE_SIZE_FLAG) && !parse_size(params.at(CACHE_SIZE_FLAG), options.cache_size))
+    {
+        std::cerr << "Error: Invalid cache size: " << params.at(CACHE_SIZE_FLAG) << "\n";
+        return 1;
+    }
+
+    if (params.count(DICT_MEMORY_FLAG) && !parse_size(params.at(DICT_MEMORY_FLAG), options.dictionary_memory))
+    {
+        std::cerr << "Error: Invalid dictionary memory size: " << params.at(DICT_MEMORY_FLAG) << "\n";
+        return 1;
+    }
+
+    if (params.count(BATCH_ROWS_FLAG))
+    {
+        const std::string &raw_rows = params.at(BATCH_ROWS_FLAG);
+        auto [end, ec] = std::from_chars(raw_rows.data(), raw_rows.data() + raw_rows.size(), options.batch_rows);
+        if (ec != std::errc() || end != raw_rows.data() + raw_rows.size())
+        {
+            std::cerr << "Error: Batch rows must be a non-negative integer, got: " << raw_rows << "\n";
+            return 1;
+        }
+    }
+
+    if (params.count(THREADS_FLAG))
+    {
+        const std::string &raw_threads = params.at(THREADS_FLAG);
+        auto [end, ec] = std::from_chars(raw_threads.data(), raw_threads.data() + raw_threads.size(), options.threads);
+        if (ec != std::errc() || end != raw_threads.data() + raw_threads.size())
+        {
+            std::cerr << "Error: Threads must be a non-negative integer, got: " << raw_threads << "\n";
+            return 1;
+        }
+        if (options.threads == 0)
+            options.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    if (params.count(KERNEL_FLAG) && !select_kernels(params.at(KERNEL_FLAG)))
+    {
+        std::cerr << "Error: Unknown or unsupported kernel level: " << params.at(KERNEL_FLAG) << " (this CPU supports:";
+        for (KernelLevel level : supported_kernel_levels())
+            std::cerr << " " << kernel_level_name(level);
+        std::cerr << ")\n";
+        return 1;
+    }
+
     std::cout << "--- PG Anonymous ---\n";
     std::cout << "Config File: " << config_file << "\n";
     std::cout << "Input File:  " << input_file << "\n";
-    std::cout << "Output File: " << output_file << "\n\n";
+    std::cout << "Output File: " << output_file << "\n";
+    std::cout << "Seed:        " << options.seed << "\n";
+    std::cout << "Kernels:     " << kernel_level_name(active_kernels().level) << "\n";
+    std::cout << "Threads:     " << options.threads << "\n\n";
 
     // 1. Initialize the processor (loads config and rules)
-    DataProcessor processor(config_file);
+    DataProcessor processor(config_file, options);
 
     // 2. Process the dump file
     int result = processor.process_dump(input_file, output_file);
@@ -0,0 +1,151 @@
+#include "pg_anonymous/BatchExecutor.hpp"
+
+BatchExecutor::BatchExecutor(size_t capacity)
+    : capacity_(capacity > 0 ? capacity : 1), lines_(capacity_), field_counts_(capacity_), ordinals_(capacity_),
+      tails_(capacity_),
+      caches_(capacity_), find_tabs_(active_kernels().find_tabs)
+{
+    contexts_.reserve(capacity_);
+}
+
+void BatchExecutor::begin(const RowSlots &slots, const std::vector<size_t> &slot_indices,
+                          const std::vector<const IRule *> &column_rules, ExecutionContext &execution)
+{
+    slots_ = &slots;
+    slot_indices_ = &slot_indices;
+    execution_ = &execution;
+    width_ = column_rules.size();
+    rows_ = 0;
+
+    rules_.clear();
+    ruled_columns_.clear();
+    result_slots_.assign(width_, RowSlots::npos);
+    for (size_t column = 0; column < width_; ++column)
+    {
+        if (!column_rules[column])
+            continue;
+        result_slots_[column] = rules_.size();
+        rules_.push_back(column_rules[column]->as_ref());
+        ruled_columns_.push_back(column);
+    }
+
+    values_.assign(width_ * capacity_, std::string_view());
+    tab_offsets_.resize(width_);
+    results_.resize(rules_.size());
+    for (auto &results : results_)
+        results.resize(capacity_);
+}
+
+void BatchExecutor::queue(std::string &line, uint64_t ordinal)
+{
+    const size_t row = rows_++;
+    lines_[row].swap(line);
+    ordinals_[row] = ordinal;
+    caches_[row].next_row();
+
+    // Split into the column arrays. Fields past the COPY column list are kept as one tail, tab included: one scan
+    // for up to width_ tabs finds both the column boundaries and where such a tail starts.
+    const std::string_view rest(lines_[row]);
+    const size_t tabs = find_tabs_(rest.data(), rest.size(), tab_offsets_.data(), width_);
+    size_t start = 0;
+    for (size_t field = 0; field < tabs; ++field)
+    {
+        values_[field * capacity_ + row] = rest.substr(start, tab_offsets_[field] - start);
+        start = tab_offsets_[field] + 1;
+    }
+    tails_[row] = {};
+    if (tabs < width_)
+    {
+        values_[tabs * capacity_ + row] = rest.substr(start);
+        field_counts_[row] = tabs + 1;
+    }
+    else
+    {
+        tails_[row] = rest.substr(tab_offsets_[width_ - 1]);
+        field_counts_[row] = width_;
+    }
+}
+
+void BatchExecutor::flush(std::ostream &out)
+{
+    if (rows_ == 0)
+        return;
+
+    output_.clear();
+    flush(output_);
+    out << output_;
+}
+
+void BatchExecutor::flush(std::string &out)
+{
+    if (rows_ == 0)
+        return;
+
+    contexts_.clear();
+    for (size_t row = 0; row < rows_; ++row)
+    {
+        const RowValues row_values(&values_[row], field_counts_[row], capacity_);
+        contexts_.push_back(RowContext{*slots_, *slot_indices_, row_values, caches_[row], *execution_, ordinals_[row]});
+    }
+
+    // Column by column. A short row has no value for the trailing columns, so each rule runs over the runs of rows
+    // that have its column; in a well-formed block that is the whole batch.
+    for (size_t rule = 0; rule < rules_.size(); ++rule)
+    {
+        const size_t column = ruled_columns_[rule];
+        const std::string_view *column_values = &values_[column * capacity_];
+        size_t first = 0;
+        while (first < rows_)
+        {
+            if (field_counts_[first] <= column)
+            {
+                ++first;
+                continue;
+            }
+            size_t last = first;
+            while (last < rows_ && field_counts_[last] > column)
+                ++last;
+            try
+            {
+                apply_rule_batch(rules_[rule], std::span(column_values + first, last - first),
+                                 std::span(contexts_.data() + first, last - first),
+                                 std::span(results_[rule].data() + first, last - first));
+            }
+            catch (const std::exception &e)
+            {
+                // Rerun the rows one at a time to name the one that failed.
+                rows_ = 0;
+                for (size_t row = first; row < last; ++row)
+                {
+                    try
+                    {
+                        apply_rule(rules_[rule], std::string(column_values[row]), contexts_[row]);
+                    }
+                    catch (const std::exception &row_error)
+                    {
+                        throw RowError(column, ordinals_[row], row_error.what());
+                    }
+                }
+                throw RowError(column, ordinals_[first], e.what());
+            }
+            first = last;
+        }
+    }
+
+    for (size_t row = 0; row < rows_; ++row)
+    {
+        for (size_t column = 0; column < field_counts_[row]; ++column)
+        {
+            if (column > 0)
+                out += '\t';
+            const size_t result = result_slots_[column];
+            if (result != RowSlots::npos)
+                out += results_[result][row];
+            else
+                out += values_[column * capacity_ + row];
+        }
+        out += tails_[row];
+        out += '\n';
+    }
+    rows_ = 0;
+}
@@ -0,0 +1,462 @@
+#include "pg_anonymous/Crypto.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+namespace
+{
+
+constexpr size_t kSha256BlockSize = 64;
+
+struct MdCtxDeleter
+{
+    void operator()(EVP_MD_CTX *ctx) const
+    {
+        EVP_MD_CTX_free(ctx);
+    }
+};
+
+/**
+ * @brief The calling thread's working context. Every HmacSha256 copies its keyed state over it, so one allocation
+ * per thread serves all of them.
+ */
+EVP_MD_CTX *thread_context()
+{
+    thread_local std::unique_ptr<EVP_MD_CTX, MdCtxDeleter> ctx(EVP_MD_CTX_new());
+    if (!ctx)
+        throw CryptoError("cannot allocate a digest context");
+    return ctx.get();
+}
+
+const EVP_MD *sha256()
+{
+    // Fetched once instead of implicitly on every EVP_DigestInit.
+    static const EVP_MD *md = EVP_MD_fetch(nullptr, "SHA256", nullptr);
+    if (!md)
+        throw CryptoError("SHA-256 is not available from OpenSSL");
+    return md;
+}
+
+void check(int ok, const char *what)
+{
+    if (ok != 1)
+        throw CryptoError(std::string("OpenSSL ") + what + " failed");
+}
+
+} // namespace
+
+std::string resolve_key(const std::string &spec)
+{
+    std::string key = spec;
+    if (spec.starts_with("env:"))
+    {
+        const char *value = std::getenv(spec.c_str() + 4);
+        if (!value)
+            throw CryptoError("environment variable " + spec.substr(4) + " is not set");
+        key = value;
+    }
+    if (key.empty())
+        throw CryptoError("empty key");
+    return key;
+}
+
+HmacSha256::HmacSha256(std::string_view key)
+{
+    const EVP_MD *md = sha256();
+    unsigned char block[kSha256BlockSize] = {};
+
+    // Keys longer than a block are replaced by their digest (RFC 2104).
+    if (key.size() > kSha256BlockSize)
+    {
+        unsigned int size = 0;
+        check(EVP_Digest(key.data(), key.size(), block, &size, md, nullptr), "key digest");
+    }
+    else
+    {
+        std::copy(key.begin(), key.end(), block);
+    }
+
+    inner_ = EVP_MD_CTX_new();
+    outer_ = EVP_MD_CTX_new();
+    try
+    {
+        if (!inner_ || !outer_)
+            throw CryptoError("cannot allocate a digest context");
+
+        unsigned char pad[kSha256BlockSize];
+        for (size_t i = 0; i < kSha256BlockSize; ++i)
+            pad[i] = block[i] ^ 0x36;
+        check(EVP_DigestInit_ex(inner_, md, nullptr), "digest init");
+        check(EVP_DigestUpdate(inner_, pad, sizeof(pad)), "digest update");
+
+        for (size_t i = 0; i < kSha256BlockSize; ++i)
+            pad[i] = block[i] ^ 0x5c;
+        check(EVP_DigestInit_ex(outer_, md, nullptr), "digest init");
+        check(EVP_DigestUpdate(outer_, pad, sizeof(pad)), "digest update");
+        OPENSSL_cleanse(pad, sizeof(pad));
+    }
+    catch (...)
+    {
+        OPENSSL_cleanse(block, sizeof(block));
+        EVP_MD_CTX_free(inner_);
+        EVP_MD_CTX_free(outer_);
+        throw;
+    }
+    OPENSSL_cleanse(block, sizeof(block));
+}
+
+HmacSha256::~HmacSha256()
+{
+    EVP_MD_CTX_free(inner_);
+    EVP_MD_CTX_free(outer_);
+}
+
+HmacSha256::Digest HmacSha256::digest(std::string_view data) const
+{
+    EVP_MD_CTX *ctx = thread_context();
+    Digest inner_digest;
+    Digest result;
+    unsigned int size = 0;
+
+    check(EVP_MD_CTX_copy_ex(ctx, inner_), "digest copy");
+    check(EVP_DigestUpdate(ctx, data.data(), data.size()), "digest update");
+    check(EVP_DigestFinal_ex(ctx, inner_digest.data(), &size), "digest final");
+
+    check(EVP_MD_CTX_copy_ex(ctx, outer_), "digest copy");
+    check(EVP_DigestUpdate(ctx, inner_digest.data(), inner_digest.size()), "digest update");
+    check(EVP_DigestFinal_ex(ctx, result.data(), &size), "digest final");
+    return result;
+}
+
+// --- Digest Encodings ---
+
+std::optional<DigestEncoding> parse_digest_encoding(const std::string &name)
+{
+    if (name == "hex")
+        return DigestEncoding::Hex;
+    if (name == "base32")
+        return DigestEncoding::Base32;
+    if (name == "numeric")
+        return DigestEncoding::Numeric;
+    return std::nullopt;
+}
+
+std::string encode_digest(const unsigned char *digest, size_t size, DigestEncoding encoding, size_t length)
+{
+    std::string out;
+    switch (encoding)
+    {
+    case DigestEncoding::Hex: {
+        static constexpr char kHex[] = "0123456789abcdef";
+        out.reserve(2 * size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            out += kHex[digest[i] >> 4];
+            out += kHex[digest[i] & 0xF];
+        }
+        break;
+    }
+    case DigestEncoding::Base32: {
+        static constexpr char kBase32[] = "abcdefghijklmnopqrstuvwxyz234567";
+        uint32_t buffer = 0;
+        int bits = 0;
+        for (size_t i = 0; i < size; ++i)
+        {
+            buffer = (buffer << 8) | digest[i];
+            bits += 8;
+            while (bits >= 5)
+            {
+                out += kBase32[(buffer >> (bits - 5)) & 31];
+                bits -= 5;
+            }
+        }
+        if (bits > 0)
+            out += kBase32[(buffer << (5 - bits)) & 31];
+        break;
+    }
+    case DigestEncoding::Numeric: {
+        // The first 8 bytes as a big-endian integer, zero-padded to the 20 digits of UINT64_MAX.
+        uint64_t value = 0;
+        for (size_t i = 0; i < 8 && i < size; ++i)
+            value = (value << 8) | digest[i];
+        out.assign(20, '0');
+        for (size_t i = out.size(); i-- > 0 && value > 0; value /= 10)
+            out[i] = static_cast<char>('0' + value % 10);
+        // Keep the low-order digits: the leading ones are biased towards 0 and 1.
+        if (length > 0 && length < out.size())
+            out.erase(0, out.size() - length);
+        return out;
+    }
+    }
+
+    if (length > 0 && length < out.size())
+        out.resize(length);
+    return out;
+}
+
+// --- Format-Preserving Encryption ---
+
+namespace
+{
+
+constexpr size_t kAesBlockSize = 16;
+
+struct CipherCtxDeleter
+{
+    void operator()(EVP_CIPHER_CTX *ctx) const
+    {
+        EVP_CIPHER_CTX_free(ctx);
+    }
+};
+
+struct BnDeleter
+{
+    void operator()(BIGNUM *bn) const
+    {
+        BN_free(bn);
+    }
+};
+
+struct BnCtxDeleter
+{
+    void operator()(BN_CTX *ctx) const
+    {
+        BN_CTX_free(ctx);
+    }
+};
+
+using Bignum = std::unique_ptr<BIGNUM, BnDeleter>;
+
+Bignum make_bignum()
+{
+    Bignum bn(BN_new());
+    if (!bn)
+        throw CryptoError("cannot allocate a BIGNUM");
+    return bn;
+}
+
+/**
+ * @brief The calling thread's AES context, re-keyed by copying only when a different Ff1Cipher last used it.
+ */
+EVP_CIPHER_CTX *thread_cipher(const EVP_CIPHER_CTX *keyed, uint64_t id)
+{
+    thread_local std::unique_ptr<EVP_CIPHER_CTX, CipherCtxDeleter> ctx(EVP_CIPHER_CTX_new());
+    thread_local uint64_t owner = 0;
+    if (!ctx)
+        throw CryptoError("cannot allocate a cipher context");
+    if (owner != id)
+    {
+        check(EVP_CIPHER_CTX_copy(ctx.get(), keyed), "cipher copy");
+        owner = id;
+    }
+    return ctx.get();
+}
+
+void encrypt_block(EVP_CIPHER_CTX *ctx, const unsigned char *in, unsigned char *out)
+{
+    int size = 0;
+    check(EVP_EncryptUpdate(ctx, out, &size, in, kAesBlockSize), "AES");
+}
+
+int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+std::vector<unsigned char> aes_key_from(std::string_view key)
+{
+    std::vector<unsigned char> bytes;
+    if (key.size() == 32 || key.size() == 48 || key.size() == 64)
+    {
+        for (size_t i = 0; i < key.size(); i += 2)
+        {
+            int hi = hex_value(key[i]), lo = hex_value(key[i + 1]);
+            if (hi < 0 || lo < 0)
+            {
+                bytes.clear();
+                break;
+            }
+            bytes.push_back(static_cast<unsigned char>(hi << 4 | lo));
+        }
+        if (!bytes.empty())
+            return bytes;
+    }
+
+    bytes.resize(32);
+    unsigned int size = 0;
+    check(EVP_Digest(key.data(), key.size(), bytes.data(), &size, sha256(), nullptr), "key digest");
+    return bytes;
+}
+
+} // namespace
+
+Ff1Cipher::Ff1Cipher(std::string_view key)
+{
+    static std::atomic<uint64_t> next_id{1};
+    id_ = next_id++;
+
+    std::vector<unsigned char> aes_key = aes_key_from(key);
+    const EVP_CIPHER *aes = aes_key.size() == 16   ? EVP_aes_128_ecb()
+                            : aes_key.size() == 24 ? EVP_aes_192_ecb()
+                                                   : EVP_aes_256_ecb();
+    cipher_ = EVP_CIPHER_CTX_new();
+    int ok = cipher_ ? EVP_EncryptInit_ex(cipher_, aes, nullptr, aes_key.data(), nullptr) : 0;
+    OPENSSL_cleanse(aes_key.data(), aes_key.size());
+    if (ok == 1)
+        ok = EVP_CIPHER_CTX_set_padding(cipher_, 0);
+    if (ok != 1)
+    {
+        EVP_CIPHER_CTX_free(cipher_);
+        throw CryptoError("cannot set up the AES key");
+    }
+}
+
+Ff1Cipher::~Ff1Cipher()
+{
+    EVP_CIPHER_CTX_free(cipher_);
+}
+
+size_t Ff1Cipher::min_length(unsigned radix)
+{
+    size_t length = 2;
+    for (uint64_t domain = uint64_t(radix) * radix; domain < kMinDomain; domain *= radix)
+        ++length;
+    return length;
+}
+
+void Ff1Cipher::transform(std::vector<uint16_t> &numerals, unsigned radix, bool decrypt) const
+{
+    const size_t n = numerals.size();
+    if (radix < 2 || radix > kMaxRadix)
+        throw CryptoError("FF1 needs a radix in [2, 65536]");
+    if (n < min_length(radix))
+        throw CryptoError("FF1 at radix " + std::to_string(radix) + " needs at least " +
+                          std::to_string(min_length(radix)) + " numerals");
+
+    EVP_CIPHER_CTX *aes = thread_cipher(cipher_, id_);
+    std::unique_ptr<BN_CTX, BnCtxDeleter> bn_ctx(BN_CTX_new());
+    if (!bn_ctx)
+        throw CryptoError("cannot allocate a BN_CTX");
+
+    const size_t u = n / 2, v = n - u;
+    std::vector<uint16_t> a(numerals.begin(), numerals.begin() + u);
+    std::vector<uint16_t> b(numerals.begin() + u, numerals.end());
+
+    // radix^u and radix^v, and b = bytes needed for NUM_radix of a v-numeral string.
+    Bignum radix_bn = make_bignum(), modulus_u = make_bignum(), modulus_v = make_bignum(), exponent = make_bignum();
+    check(BN_set_word(radix_bn.get(), radix), "BN_set_word");
+    check(BN_set_word(exponent.get(), u), "BN_set_word");
+    check(BN_exp(modulus_u.get(), radix_bn.get(), exponent.get(), bn_ctx.get()), "BN_exp");
+    check(BN_set_word(exponent.get(), v), "BN_set_word");
+    check(BN_exp(modulus_v.get(), radix_bn.get(), exponent.get(), bn_ctx.get()), "BN_exp");
+    check(BN_copy(exponent.get(), modulus_v.get()) ? 1 : 0, "BN_copy");
+    check(BN_sub_word(exponent.get(), 1), "BN_sub_word");
+    const size_t num_bytes = (BN_num_bits(exponent.get()) + 7) / 8;
+    const size_t d = 4 * ((num_bytes + 3) / 4) + 4;
+
+    // P = [1][2][1] [radix]^3 [10] [u mod 256] [n]^4 [t = 0]^4
+    unsigned char p[kAesBlockSize] = {1, 2, 1, static_cast<unsigned char>(radix >> 16),
+                                      static_cast<unsigned char>(radix >> 8), static_cast<unsigned char>(radix), 10,
+                                      static_cast<unsigned char>(u & 0xFF), static_cast<unsigned char>(n >> 24),
+                                      static_cast<unsigned char>(n >> 16), static_cast<unsigned char>(n >> 8),
+                                      static_cast<unsigned char>(n), 0, 0, 0, 0};
+    unsigned char p_cipher[kAesBlockSize];
+    encrypt_block(aes, p, p_cipher);
+
+    // Q = [0]^((-b-1) mod 16) [i] [NUM_radix(X)]^b, with an empty tweak.
+    const size_t q_size = ((num_bytes + 1 + kAesBlockSize - 1) / kAesBlockSize) * kAesBlockSize;
+    std::vector<unsigned char> q(q_size);
+    std::vector<unsigned char> s(((d + kAesBlockSize - 1) / kAesBlockSize) * kAesBlockSize);
+
+    Bignum x = make_bignum(), y = make_bignum(), c = make_bignum();
+    auto num_radix = [&](const std::vector<uint16_t> &digits, BIGNUM *out) {
+        BN_zero(out);
+        for (uint16_t digit : digits)
+        {
+            check(BN_mul_word(out, radix), "BN_mul_word");
+            check(BN_add_word(out, digit), "BN_add_word");
+        }
+    };
+
+    for (int round = 0; round < 10; ++round)
+    {
+        const int i = decrypt ? 9 - round : round;
+        const std::vector<uint16_t> &source = decrypt ? a : b;
+
+        // R = PRF(P || Q): CBC-MAC, continuing from the encrypted P block.
+        num_radix(source, x.get());
+        std::fill(q.begin(), q.end(), 0);
+        q[q_size - num_bytes - 1] = static_cast<unsigned char>(i);
+        if (BN_bn2binpad(x.get(), q.data() + q_size - num_bytes, static_cast<int>(num_bytes)) < 0)
+            throw CryptoError("OpenSSL BN_bn2binpad failed");
+
+        unsigned char r[kAesBlockSize];
+        std::memcpy(r, p_cipher, kAesBlockSize);
+        for (size_t offset = 0; offset < q_size; offset += kAesBlockSize)
+        {
+            for (size_t k = 0; k < kAesBlockSize; ++k)
+                r[k] ^= q[offset + k];
+            encrypt_block(aes, r, r);
+        }
+
+        // S = R || CIPH(R xor [1]) || CIPH(R xor [2]) ..., truncated to d bytes.
+        std::memcpy(s.data(), r, kAesBlockSize);
+        for (size_t j = 1; j * kAesBlockSize < d; ++j)
+        {
+            unsigned char block[kAesBlockSize];
+            std::memcpy(block, r, kAesBlockSize);
+            for (size_t k = 0; k < 8; ++k)
+                block[kAesBlockSize - 1 - k] ^= static_cast<unsigned char>(j >> (8 * k));
+            encrypt_block(aes, block, s.data() + j * kAesBlockSize);
+        }
+        if (!BN_bin2bn(s.data(), static_cast<int>(d), y.get()))
+            throw CryptoError("OpenSSL BN_bin2bn failed");
+
+        // c = (NUM_radix(A) + y) mod radix^m when encrypting, (NUM_radix(B) - y) mod radix^m when decrypting.
+        const size_t m = i % 2 == 0 ? u : v;
+        const BIGNUM *modulus = i % 2 == 0 ? modulus_u.get() : modulus_v.get();
+        num_radix(decrypt ? b : a, x.get());
+        if (decrypt)
+            check(BN_sub(c.get(), x.get(), y.get()), "BN_sub");
+        else
+            check(BN_add(c.get(), x.get(), y.get()), "BN_add");
+        check(BN_nnmod(c.get(), c.get(), modulus, bn_ctx.get()), "BN_nnmod");
+
+        std::vector<uint16_t> result(m);
+        for (size_t k = m; k-- > 0;)
+        {
+            BN_ULONG digit = BN_div_word(c.get(), radix);
+            if (digit == static_cast<BN_ULONG>(-1))
+                throw CryptoError("OpenSSL BN_div_word failed");
+            result[k] = static_cast<uint16_t>(digit);
+        }
+
+        if (decrypt)
+        {
+            b = std::move(a);
+            a = std::move(result);
+        }
+        else
+        {
+            a = std::move(b);
+            b = std::move(result);
+        }
+    }
+
+    std::copy(a.begin(), a.end(), numerals.begin());
+    std::copy(b.begin(), b.end(), numerals.begin() + u);
+}
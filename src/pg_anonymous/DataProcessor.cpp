@@ -1,9 +1,13 @@
 #include "pg_anonymous/DataProcessor.hpp"
 #include <algorithm>
+#include <filesystem>
 #include <fstream>
+#include <iomanip>
+#include <optional>
 #include <regex>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 void DataProcessor::parse_copy_columns(const std::string &raw_columns, std::vector<std::string> &columns) const
 {
@@ -25,13 +29,50 @@ void DataProcessor::parse_copy_columns(const std::string &raw_columns, std::vect
     }
 }
 
-DataProcessor::DataProcessor(const std::string &config_file_path)
+std::vector<const IRule *> DataProcessor::resolve_column_rules(const TableRules &table_rules,
+                                                              const std::vector<std::string> &columns) const
+{
+    // Dense plan indexed by column position; nullptr means the value passes through untouched.
+    std::vector<const IRule *> column_rules(columns.size(), nullptr);
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        auto it = table_rules.columns.find(columns[i]);
+        if (it != table_rules.columns.end())
+            column_rules[i] = it->second.get();
+    }
+    return column_rules;
+}
+
+/**
+ * @brief Removes the partial output of a failed run, so it cannot be mistaken for a complete dump.
+ * @return The exit status of the failed run.
+ */
+int DataProcessor::discard_output(std::ofstream &out, const std::string &output_file_path)
+{
+    out.close();
+    std::error_code ignored;
+    std::filesystem::remove(output_file_path, ignored);
+    return 1;
+}
+
+bool DataProcessor::is_copy_end_marker(const std::string &line)
+{
+    // Equivalent to ^\s*\\\.\s*$ without running a regex on every data row.
+    size_t first = line.find_first_not_of(" \t\r\n\f\v");
+    if (first == std::string::npos || line.compare(first, 2, "\\.") != 0)
+        return false;
+    return line.find_first_not_of(" \t\r\n\f\v", first + 2) == std::string::npos;
+}
+
+DataProcessor::DataProcessor(const std::string &config_file_path, const ProcessorOptions &options)
+    : options_(options), environment_(options.seed, options.dictionary_memory)
 {
     try
     {
         config_ = YAML::LoadFile(config_file_path);
-        replacement_rules_ = load_rules(config_);
+        // The catalog must exist before the rules: catalog picks are resolved while rules are compiled.
         replacement_catalog_ = load_catalog(config_);
+        replacement_rules_ = load_rules(config_);
     }
     catch (const std::exception &e)
     {
@@ -62,7 +103,7 @@ ReplacementCatalog DataProcessor::load_catalog(const YAML::Node &config)
     return catalog;
 }
 
-ReplacementRules DataProcessor::load_rules(const YAML::Node &config) const
+ReplacementRules DataProcessor::load_rules(const YAML::Node &config)
 {
     ReplacementRules rules;
     if (!config["rules"] || !config["rules"].IsMap())
@@ -93,7 +134,18 @@ ReplacementRules DataProcessor::load_rules(const YAML::Node &config) const
                         std::string col = rule_it->first.as<std::string>();
                         std::string raw_template = rule_it->second.as<std::string>();
 
-                        rules[table_name][col] = RuleFactory::parse_template(raw_template, replacement_catalog_);
+                        TableRules &table_rules = rules[table_name];
+                        environment_.streams.enter_scope(table_name, col);
+                        auto rule = RuleFactory::compile_template(raw_template, replacement_catalog_,
+                                                                  table_rules.row_slots, environment_);
+                        if (options_.cache_size > 0)
+                        {
+                            std::vector<std::shared_ptr<MemoizedRule>> caches;
+                            rule = RuleFactory::memoize(rule, options_.cache_size, environment_.layout, caches);
+                            for (auto &cache : caches)
+                                memo_caches_.emplace_back(table_name + "." + col, std::move(cache));
+                        }
+                        table_rules.columns[col] = rule;
 
                         std::cout << "Loaded rule for " << table_name << "." << col << ": " << raw_template << "\n";
                     }
@@ -101,6 +153,9 @@ ReplacementRules DataProcessor::load_rules(const YAML::Node &config) const
             }
         }
     }
+
+    for (auto &[table_name, table_rules] : rules)
+        table_rules.row_slots.build_match_sets();
     return rules;
 }
 
@@ -113,98 +168,139 @@ int DataProcessor::process_dump(const std::string &input_file_path, const std::s
         return 1;
 
     const std::regex copy_pattern(R"(^\s*COPY\s+([\w\.]+)\s*(\([^;]+\))?\s+FROM\s+stdin\s*;\s*$)", std::regex::icase);
-    const std::regex end_pattern(R"(^\s*\\\.\s*$)", std::regex::optimize);
     std::smatch matches;
 
     ParserState state = ParserState::SearchingForCopy;
     std::string line, current_table;
     std::vector<std::string> columns;
+    const RowSlots *row_slots = nullptr;
+    std::vector<size_t> slot_indices;
+    ExecutionContext execution(environment_.layout);
+    std::vector<const IRule *> column_rules;
+    uint64_t ordinal = 0; // of the next data row in the block
+    std::string processed_line;
+    RowExecutor rows;
+    std::optional<BatchExecutor> batch;
+    std::optional<ParallelExecutor> parallel;
+    if (options_.threads > 1)
+        parallel.emplace(options_.threads, options_.batch_rows, environment_.layout);
+    else if (options_.batch_rows > 0)
+        batch.emplace(options_.batch_rows);
 
-    while (std::getline(file, line))
+    try
     {
-        if (state == ParserState::SearchingForCopy)
+        while (std::getline(file, line))
         {
-            if (std::regex_match(line, matches, copy_pattern))
+            if (state == ParserState::SearchingForCopy)
             {
-                current_table = matches[1].str();
-                out << line << "\n";
-                columns.clear();
-                if (matches.size() > 2 && matches[2].matched)
-                    parse_copy_columns(matches[2].str(), columns);
-                state = ParserState::ReadingData;
-            }
-            else
-            {
-                out << line << "\n";
-            }
-        }
-        else if (state == ParserState::ReadingData)
-        {
-            if (std::regex_match(line, end_pattern))
-            {
-                out << line << "\n";
-                state = ParserState::SearchingForCopy;
-                columns.clear();
-            }
-            else
-            {
-                if (replacement_rules_.count(current_table) && !columns.empty())
+                if (std::regex_match(line, matches, copy_pattern))
                 {
-                    // 1. Split the raw line into two vectors
-                    std::vector<std::string> original_row_values; // Immutable copy for RowContext
-                    std::vector<std::string> working_row_values;  // Mutable copy for transformation
-
-                    std::stringstream ss(line);
-                    std::string token;
-                    while (std::getline(ss, token, '\t'))
+                    current_table = matches[1].str();
+                    out << line << "\n";
+                    columns.clear();
+                    if (matches.size() > 2 && matches[2].matched)
+                        parse_copy_columns(matches[2].str(), columns);
+                    // Resolve the table's rules and column references once per COPY block so the
+                    // per-row loop only does indexed lookups.
+                    slot_indices.clear();
+                    column_rules.clear();
+                    ordinal = 0;
+                    auto table_it = replacement_rules_.find(current_table);
+                    if (table_it != replacement_rules_.end() && !columns.empty())
                     {
-                        original_row_values.push_back(token);
-                        working_row_values.push_back(token);
+                        row_slots = &table_it->second.row_slots;
+                        slot_indices = row_slots->bind(columns, current_table);
+                        column_rules = resolve_column_rules(table_it->second, columns);
+                        rows.begin(*row_slots, slot_indices, column_rules, execution);
+                        if (batch)
+                            batch->begin(*row_slots, slot_indices, column_rules, execution);
+                        if (parallel)
+                            parallel->begin(*row_slots, slot_indices, column_rules);
                     }
-
-                    // 2. Create Context: ONLY use the ORIGINAL data to meet the requirement.
-                    RowContext ctx{columns, original_row_values};
-
-                    // 3. Iterate and apply rules
-                    std::string processed_line;
-                    const auto &table_rules = replacement_rules_.at(current_table);
-
-                    for (size_t i = 0; i < working_row_values.size(); ++i)
-                    {
-                        // Pass the current working value as the 'original_value' to the rule.
-                        // For a CompositeRule, this 'original_value' is the one that gets passed
-                        // to its sub-rules (StaticText, HASH, REGEX, etc.).
-                        std::string val = working_row_values[i];
-
-                        if (i < columns.size())
-                        {
-                            const std::string &col_name = columns[i];
-                            if (table_rules.count(col_name))
-                            {
-                                // APPLY THE RULE
-                                // Rule functions (like HASH, MATCHES) now use ctx.get_column_value()
-                                // to retrieve ORIGINAL data based on column name.
-                                val = table_rules.at(col_name)->apply(val, ctx);
-
-                                // Update the WORKING copy for final output
-                                working_row_values[i] = val;
-                            }
-                        }
-
-                        if (i > 0)
-                            processed_line += "\t";
-                        // Output the (potentially) transformed value
-                        processed_line += val;
-                    }
-                    out << processed_line << "\n";
+                    state = ParserState::ReadingData;
                 }
                 else
                 {
-                    // No rules for this table/row, write line as-is.
                     out << line << "\n";
                 }
             }
+            else if (state == ParserState::ReadingData)
+            {
+                if (is_copy_end_marker(line))
+                {
+                    if (batch)
+                        batch->flush(out);
+                    if (parallel)
+                        parallel->flush(out);
+                    out << line << "\n";
+                    state = ParserState::SearchingForCopy;
+                    columns.clear();
+                    column_rules.clear();
+                }
+                else
+                {
+                    if (!column_rules.empty() && parallel)
+                    {
+                        parallel->push(line, out);
+                    }
+                    else if (!column_rules.empty() && batch)
+                    {
+                        batch->push(line, ordinal++, out);
+                    }
+                    else if (!column_rules.empty())
+                    {
+                        processed_line.clear();
+                        rows.transform(line, ordinal++, processed_line);
+                        out << processed_line;
+                    }
+                    else
+                    {
+                        // No rules for this table/row, write line as-is.
+                        out << line << "\n";
+                    }
+                }
+            }
         }
+
+        // A dump cut off inside a COPY block
+        if (batch)
+            batch->flush(out);
+        if (parallel)
+            parallel->flush(out);
+    }
+    catch (const RowError &e)
+    {
+        const std::string column = e.column() < columns.size() ? columns[e.column()] : std::to_string(e.column() + 1);
+        std::cerr << "Processing Error in " << current_table << "." << column << " (data row " << e.ordinal() + 1
+                  << " of its COPY block): " << e.what() << std::endl;
+        return discard_output(out, output_file_path);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Processing Error in " << current_table << ": " << e.what() << std::endl;
+        return discard_output(out, output_file_path);
     }
+    report_cache_stats(parallel ? parallel->contexts() : std::vector<const ExecutionContext *>{&execution});
     return 0;
+}
+
+void DataProcessor::report_cache_stats(const std::vector<const ExecutionContext *> &contexts) const
+{
+    for (const auto &[column, memoized] : memo_caches_)
+    {
+        // Summed over the threads' caches; disabled once every thread's cache turned itself off.
+        MemoStats stats;
+        stats.disabled = true;
+        for (const ExecutionContext *execution : contexts)
+        {
+            const MemoStats &thread_stats = execution->memo_caches[memoized->cache()].stats();
+            stats.lookups += thread_stats.lookups;
+            stats.hits += thread_stats.hits;
+            stats.evictions += thread_stats.evictions;
+            stats.disabled = stats.disabled && thread_stats.disabled;
+        }
+        std::cout << "Cache " << column << ": " << stats.lookups << " lookups, " << std::fixed << std::setprecision(1)
+                  << 100.0 * stats.hit_rate() << "% hits, " << stats.evictions << " evictions"
+                  << (stats.disabled ? " (disabled: low hit rate)" : "") << "\n";
+    }
 }
\ No newline at end of file
@@ -0,0 +1,239 @@
+#include "pg_anonymous/Dates.hpp"
+
+#include <charconv>
+
+namespace
+{
+
+bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/** Reads exactly `width` digits at `pos`. */
+bool read_fixed(std::string_view text, size_t &pos, size_t width, unsigned &value)
+{
+    if (pos + width > text.size())
+        return false;
+    value = 0;
+    for (size_t i = 0; i < width; ++i)
+    {
+        const char c = text[pos + i];
+        if (!is_digit(c))
+            return false;
+        value = value * 10 + static_cast<unsigned>(c - '0');
+    }
+    pos += width;
+    return true;
+}
+
+bool is_leap(int64_t year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+unsigned days_in_month(int64_t year, unsigned month)
+{
+    static constexpr unsigned kDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    return month == 2 && is_leap(year) ? 29 : kDays[month - 1];
+}
+
+/** Appends `value` zero-padded to at least `width` digits. */
+void append_padded(std::string &out, int64_t value, size_t width)
+{
+    char digits[24];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    const size_t length = static_cast<size_t>(result.ptr - digits);
+    if (length < width)
+        out.append(width - length, '0');
+    out.append(digits, length);
+}
+
+// PostgreSQL prints years past 9999 in full; its date range ends in 5874897.
+constexpr size_t kMaxYearDigits = 7;
+
+} // namespace
+
+int64_t days_from_civil(int64_t year, unsigned month, unsigned day)
+{
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const int64_t year_of_era = year - era * 400;
+    const int64_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+void civil_from_days(int64_t days, int64_t &year, unsigned &month, unsigned &day)
+{
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const int64_t day_of_era = days - era * 146097;
+    const int64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    const int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    const int64_t month_index = (5 * day_of_year + 2) / 153;
+    day = static_cast<unsigned>(day_of_year - (153 * month_index + 2) / 5 + 1);
+    month = static_cast<unsigned>(month_index < 10 ? month_index + 3 : month_index - 9);
+    year = year_of_era + era * 400 + (month <= 2);
+}
+
+bool PgDateTime::parse(std::string_view text, PgDateTime &value)
+{
+    size_t pos = 0;
+    while (pos < text.size() && pos < kMaxYearDigits && is_digit(text[pos]))
+        ++pos;
+    if (pos < 4 || pos >= text.size() || text[pos] != '-')
+        return false;
+    int64_t year = 0;
+    std::from_chars(text.data(), text.data() + pos, year);
+    ++pos;
+
+    unsigned month, day;
+    if (!read_fixed(text, pos, 2, month) || pos >= text.size() || text[pos++] != '-' || !read_fixed(text, pos, 2, day))
+        return false;
+    if (year < 1 || month < 1 || month > 12 || day < 1 || day > days_in_month(year, month))
+        return false;
+
+    value = PgDateTime();
+    value.days = days_from_civil(year, month, day);
+    if (pos == text.size())
+        return true;
+
+    // " HH:MM:SS"
+    if (text[pos++] != ' ' || !read_fixed(text, pos, 2, value.hour) || pos >= text.size() || text[pos++] != ':' ||
+        !read_fixed(text, pos, 2, value.minute) || pos >= text.size() || text[pos++] != ':' ||
+        !read_fixed(text, pos, 2, value.second))
+        return false;
+    if (value.hour > 24 || value.minute > 59 || value.second > 60)
+        return false;
+    value.has_time = true;
+
+    // ".ffffff"
+    if (pos < text.size() && text[pos] == '.')
+    {
+        const size_t start = pos++;
+        while (pos < text.size() && is_digit(text[pos]))
+            ++pos;
+        if (pos == start + 1)
+            return false;
+        value.fraction = text.substr(start, pos - start);
+    }
+
+    // "±HH[:MM[:SS]]"
+    if (pos < text.size())
+    {
+        const size_t start = pos;
+        if (text[pos] != '+' && text[pos] != '-')
+            return false;
+        ++pos;
+        unsigned part;
+        if (!read_fixed(text, pos, 2, part))
+            return false;
+        for (int i = 0; i < 2 && pos < text.size(); ++i)
+        {
+            if (text[pos++] != ':' || !read_fixed(text, pos, 2, part))
+                return false;
+        }
+        if (pos != text.size())
+            return false;
+        value.zone = text.substr(start);
+    }
+    return true;
+}
+
+bool PgDateTime::format(std::string &out) const
+{
+    int64_t year;
+    unsigned month, day;
+    civil_from_days(days, year, month, day);
+    if (year < 1 || year > 5874897)
+        return false;
+
+    append_padded(out, year, 4);
+    out += '-';
+    append_padded(out, month, 2);
+    out += '-';
+    append_padded(out, day, 2);
+    if (has_time)
+    {
+        out += ' ';
+        append_padded(out, hour, 2);
+        out += ':';
+        append_padded(out, minute, 2);
+        out += ':';
+        append_padded(out, second, 2);
+        out += fraction;
+        out += zone;
+    }
+    return true;
+}
+
+std::optional<DateUnit> parse_date_unit(std::string_view name)
+{
+    if (name == "year")
+        return DateUnit::Year;
+    if (name == "quarter")
+        return DateUnit::Quarter;
+    if (name == "month")
+        return DateUnit::Month;
+    if (name == "week")
+        return DateUnit::Week;
+    if (name == "day")
+        return DateUnit::Day;
+    if (name == "hour")
+        return DateUnit::Hour;
+    if (name == "minute")
+        return DateUnit::Minute;
+    return std::nullopt;
+}
+
+void truncate_datetime(PgDateTime &value, DateUnit unit)
+{
+    value.fraction = {};
+    value.second = 0;
+    if (unit == DateUnit::Minute)
+        return;
+    value.minute = 0;
+    if (unit == DateUnit::Hour)
+        return;
+    value.hour = 0;
+
+    int64_t year;
+    unsigned month, day;
+    civil_from_days(value.days, year, month, day);
+    switch (unit)
+    {
+    case DateUnit::Year:
+        value.days = days_from_civil(year, 1, 1);
+        break;
+    case DateUnit::Quarter:
+        value.days = days_from_civil(year, (month - 1) / 3 * 3 + 1, 1);
+        break;
+    case DateUnit::Month:
+        value.days = days_from_civil(year, month, 1);
+        break;
+    case DateUnit::Week:
+        // 1970-01-01 was a Thursday, so Mondays are the days congruent to 4 mod 7.
+        value.days -= ((value.days - 4) % 7 + 7) % 7;
+        break;
+    default:
+        break;
+    }
+}
+
+int64_t years_between(int64_t birth_days, int64_t reference_days)
+{
+    int64_t birth_year, reference_year;
+    unsigned birth_month, birth_day, reference_month, reference_day;
+    civil_from_days(birth_days, birth_year, birth_month, birth_day);
+    civil_from_days(reference_days, reference_year, reference_month, reference_day);
+
+    int64_t years = reference_year - birth_year;
+    const bool before_birthday =
+        reference_month < birth_month || (reference_month == birth_month && reference_day < birth_day);
+    if (years > 0 && before_birthday)
+        --years;
+    else if (years < 0 && !before_birthday && (reference_month != birth_month || reference_day != birth_day))
+        ++years;
+    return years;
+}
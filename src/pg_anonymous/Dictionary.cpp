@@ -0,0 +1,390 @@
+#include "pg_anonymous/Dictionary.hpp"
+#include "pg_anonymous/Hash.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr size_t kInitialSlots = 16;
+constexpr size_t kWriteChunk = size_t(1) << 20; // bytes of records buffered before a write
+constexpr size_t kSlotsPerRead = 4096;          // a power of two, like every table size
+
+size_t table_size_for(size_t count)
+{
+    size_t size = kInitialSlots;
+    while (size < 2 * count)
+        size *= 2;
+    return size;
+}
+
+bool write_at(int fd, const char *data, size_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        const ssize_t written = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+    return true;
+}
+
+bool read_at(int fd, char *data, size_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        const ssize_t read = ::pread(fd, data, size, static_cast<off_t>(offset));
+        if (read < 0 && errno == EINTR)
+            continue;
+        if (read <= 0)
+            return false;
+        data += read;
+        size -= static_cast<size_t>(read);
+        offset += static_cast<uint64_t>(read);
+    }
+    return true;
+}
+
+} // namespace
+
+PseudonymDictionary::PseudonymDictionary(std::string name, size_t memory_budget,
+                                         std::filesystem::path spill_directory)
+    : name_(std::move(name)), memory_budget_(memory_budget), spill_directory_(std::move(spill_directory)),
+      slots_(kInitialSlots, Slot{0, kEmpty, 0, 0})
+{
+}
+
+PseudonymDictionary::~PseudonymDictionary()
+{
+    if (spill_fd_ >= 0)
+        ::close(spill_fd_);
+}
+
+bool PseudonymDictionary::find(std::string_view key, std::string &value)
+{
+    const uint64_t hash = stable_hash::hash(key);
+    std::lock_guard lock(mutex_);
+    return find_locked(key, hash, value);
+}
+
+bool PseudonymDictionary::find_locked(std::string_view key, uint64_t hash, std::string &value)
+{
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask; slots_[i].offset != kEmpty; i = (i + 1) & mask)
+    {
+        const Slot &slot = slots_[i];
+        if (slot.hash == hash && slot.key_size == key.size() &&
+            std::string_view(arena_).substr(slot.offset, slot.key_size) == key)
+        {
+            value.assign(arena_, slot.offset + slot.key_size, slot.value_size);
+            return true;
+        }
+    }
+    return !segments_.empty() && find_on_disk(key, hash, value);
+}
+
+void PseudonymDictionary::insert(std::string_view key, std::string &value)
+{
+    const uint64_t hash = stable_hash::hash(key);
+    std::lock_guard lock(mutex_);
+    if (find_locked(key, hash, value))
+        return;
+
+    if (2 * (count_ + 1) > slots_.size())
+        grow();
+
+    const Slot slot{hash, arena_.size(), static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size())};
+    arena_.append(key);
+    arena_.append(value);
+    place(slots_, slot);
+    ++count_;
+
+    if (memory_used() > memory_budget_)
+        spill();
+}
+
+void PseudonymDictionary::place(std::vector<Slot> &slots, const Slot &slot)
+{
+    const size_t mask = slots.size() - 1;
+    size_t i = slot.hash & mask;
+    while (slots[i].offset != kEmpty)
+        i = (i + 1) & mask;
+    slots[i] = slot;
+}
+
+void PseudonymDictionary::grow()
+{
+    std::vector<Slot> larger(slots_.size() * 2, Slot{0, kEmpty, 0, 0});
+    for (const Slot &slot : slots_)
+    {
+        if (slot.offset != kEmpty)
+            place(larger, slot);
+    }
+    slots_ = std::move(larger);
+}
+
+/**
+ * @brief Creates the spill file and the key its entries are hashed under.
+ * @return false, after warning, if the dictionary has to stay in memory.
+ */
+bool PseudonymDictionary::open_spill_file()
+{
+    if (spill_directory_.empty())
+    {
+        std::cerr << "Warning: No directory for spill files; keeping dictionary " << name_ << " in memory\n";
+        return false;
+    }
+
+    std::string path = "pg_anonymous-";
+    for (char c : name_)
+        path += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+    path = (spill_directory_ / (path + "-XXXXXX")).string();
+
+    // mkstemp creates the file exclusively (O_CREAT | O_EXCL) with mode 0600. Unlinking it right away leaves the
+    // descriptor as its only reference, so nothing survives the process, not even a crash.
+    spill_fd_ = ::mkstemp(path.data());
+    if (spill_fd_ < 0)
+    {
+        std::cerr << "Warning: Cannot create spill file " << path << " for dictionary " << name_ << ": "
+                  << std::strerror(errno) << "; keeping it in memory\n";
+        return false;
+    }
+    ::unlink(path.c_str());
+
+    std::random_device random;
+    std::array<uint32_t, 8> key;
+    for (uint32_t &word : key)
+        word = random();
+    spill_key_ = std::make_unique<HmacSha256>(
+        std::string_view(reinterpret_cast<const char *>(key.data()), key.size() * sizeof(uint32_t)));
+    return true;
+}
+
+void PseudonymDictionary::spill()
+{
+    if (spill_fd_ < 0 && !open_spill_file())
+    {
+        memory_budget_ = SIZE_MAX;
+        return;
+    }
+
+    SegmentWriter writer = start_segment(count_);
+    bool written = true;
+    for (const Slot &slot : slots_)
+    {
+        if (slot.offset == kEmpty)
+            continue;
+        const std::string_view key = std::string_view(arena_).substr(slot.offset, slot.key_size);
+        const HmacSha256::Digest digest = spill_key_->digest(key);
+        const std::string_view value = std::string_view(arena_).substr(slot.offset + slot.key_size, slot.value_size);
+        written = add_record(writer, slot.hash,
+                             std::string_view(reinterpret_cast<const char *>(digest.data()), digest.size()), value);
+        if (!written)
+            break;
+    }
+    Segment segment{};
+    if (!written || !finish_segment(writer, segment))
+    {
+        std::cerr << "Warning: Writing the spill file of dictionary " << name_ << " failed: " << std::strerror(errno)
+                  << "; keeping it in memory\n";
+        memory_budget_ = SIZE_MAX;
+        return;
+    }
+
+    segments_.push_back(std::move(segment));
+    spilled_count_ += count_;
+    count_ = 0;
+    slots_.assign(kInitialSlots, Slot{0, kEmpty, 0, 0});
+    slots_.shrink_to_fit();
+    std::string().swap(arena_);
+    merge_segments();
+}
+
+// Segment layout: the records (key digest, then pseudonym), then a slot table pointing back into them.
+
+PseudonymDictionary::SegmentWriter PseudonymDictionary::start_segment(size_t count) const
+{
+    return SegmentWriter{spill_size_, 0, std::string(), std::vector<Slot>(table_size_for(count), Slot{0, kEmpty, 0, 0}),
+                         0};
+}
+
+bool PseudonymDictionary::add_record(SegmentWriter &writer, uint64_t hash, std::string_view digest,
+                                     std::string_view value)
+{
+    const uint64_t offset = writer.records_offset + writer.written + writer.records.size();
+    writer.records.append(digest);
+    writer.records.append(value);
+    place(writer.table, Slot{hash, offset, static_cast<uint32_t>(digest.size()), static_cast<uint32_t>(value.size())});
+    ++writer.count;
+    return writer.records.size() < kWriteChunk || flush_records(writer);
+}
+
+bool PseudonymDictionary::flush_records(SegmentWriter &writer)
+{
+    if (!write_at(spill_fd_, writer.records.data(), writer.records.size(), writer.records_offset + writer.written))
+        return false;
+    writer.written += writer.records.size();
+    writer.records.clear();
+    return true;
+}
+
+/**
+ * @brief Writes the rest of the records and the slot table, and describes the result in `segment`.
+ */
+bool PseudonymDictionary::finish_segment(SegmentWriter &writer, Segment &segment)
+{
+    if (!flush_records(writer))
+        return false;
+
+    segment = Segment{writer.records_offset, writer.records_offset + writer.written, writer.count,
+                      std::vector<uint8_t>(writer.table.size(), 0)};
+    for (size_t i = 0; i < writer.table.size(); ++i)
+    {
+        if (writer.table[i].offset != kEmpty)
+            segment.tags[i] = tag_of(writer.table[i].hash);
+    }
+    if (!write_at(spill_fd_, reinterpret_cast<const char *>(writer.table.data()), writer.table.size() * sizeof(Slot),
+                  segment.table_offset))
+        return false;
+    spill_size_ = segment.table_offset + writer.table.size() * sizeof(Slot);
+    return true;
+}
+
+/**
+ * @brief Merges the newest two segments for as long as the older holds no more entries than the newer, or there are
+ * too many segments. Segment sizes then at least double from newest to oldest, and each entry is rewritten
+ * O(log spills) times.
+ */
+void PseudonymDictionary::merge_segments()
+{
+    while (segments_.size() >= 2 && (segments_.size() > kMaxSegments ||
+                                     segments_[segments_.size() - 2].count <= segments_.back().count))
+    {
+        if (!merge_newest_segments())
+        {
+            std::cerr << "Warning: Merging the spill file segments of dictionary " << name_
+                      << " failed: " << std::strerror(errno) << "\n";
+            return;
+        }
+    }
+}
+
+bool PseudonymDictionary::merge_newest_segments()
+{
+    const Segment &older = segments_[segments_.size() - 2];
+    const Segment &newer = segments_.back();
+    SegmentWriter writer = start_segment(older.count + newer.count);
+    Segment merged{};
+    if (!copy_records(older, writer) || !copy_records(newer, writer) || !finish_segment(writer, merged))
+        return false;
+
+    // The two segments are the last ones in the file, right before the merged one.
+    const uint64_t released = older.records_offset;
+#ifdef FALLOC_FL_PUNCH_HOLE
+    (void)::fallocate(spill_fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(released),
+                      static_cast<off_t>(merged.records_offset - released));
+#endif
+    segments_.resize(segments_.size() - 2);
+    segments_.push_back(std::move(merged));
+    return true;
+}
+
+bool PseudonymDictionary::copy_records(const Segment &segment, SegmentWriter &writer)
+{
+    // Read the slot table in chunks, then the records in file order.
+    std::vector<Slot> slots;
+    slots.reserve(segment.count);
+    std::vector<Slot> chunk(std::min(segment.tags.size(), kSlotsPerRead));
+    for (size_t first = 0; first < segment.tags.size(); first += chunk.size())
+    {
+        if (!read_at(spill_fd_, reinterpret_cast<char *>(chunk.data()), chunk.size() * sizeof(Slot),
+                     segment.table_offset + first * sizeof(Slot)))
+            return false;
+        for (const Slot &slot : chunk)
+        {
+            if (slot.offset != kEmpty)
+                slots.push_back(slot);
+        }
+    }
+    std::sort(slots.begin(), slots.end(), [](const Slot &a, const Slot &b) { return a.offset < b.offset; });
+
+    for (const Slot &slot : slots)
+    {
+        scratch_.resize(slot.key_size + slot.value_size);
+        if (!read_at(spill_fd_, scratch_.data(), scratch_.size(), slot.offset) ||
+            !add_record(writer, slot.hash, std::string_view(scratch_).substr(0, slot.key_size),
+                        std::string_view(scratch_).substr(slot.key_size)))
+            return false;
+    }
+    return true;
+}
+
+bool PseudonymDictionary::find_on_disk(std::string_view key, uint64_t hash, std::string &value)
+{
+    const uint8_t tag = tag_of(hash);
+    std::optional<HmacSha256::Digest> digest; // computed once a tag matches
+    for (auto segment = segments_.rbegin(); segment != segments_.rend(); ++segment)
+    {
+        const size_t mask = segment->tags.size() - 1;
+        for (size_t i = hash & mask; segment->tags[i] != 0; i = (i + 1) & mask)
+        {
+            if (segment->tags[i] != tag)
+                continue;
+
+            Slot slot;
+            if (!read_at(spill_fd_, reinterpret_cast<char *>(&slot), sizeof(slot),
+                         segment->table_offset + i * sizeof(Slot)) ||
+                slot.hash != hash || slot.key_size != HmacSha256::kDigestSize)
+                continue;
+
+            if (!digest)
+                digest = spill_key_->digest(key);
+            scratch_.resize(slot.key_size + slot.value_size);
+            if (read_at(spill_fd_, scratch_.data(), scratch_.size(), slot.offset) &&
+                std::memcmp(scratch_.data(), digest->data(), digest->size()) == 0)
+            {
+                value.assign(scratch_, slot.key_size, slot.value_size);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<PseudonymDictionary> PseudonymDictionaries::get(const std::string &name)
+{
+    auto it = dictionaries_.find(name);
+    if (it != dictionaries_.end())
+        return it->second;
+
+    if (!spill_directory_)
+    {
+        std::error_code ec;
+        spill_directory_ = std::filesystem::temp_directory_path(ec);
+        if (ec)
+        {
+            std::cerr << "Warning: Cannot find a temporary directory (" << ec.message()
+                      << "); dictionaries will not spill to disk\n";
+            spill_directory_->clear();
+        }
+    }
+
+    auto dictionary = std::make_shared<PseudonymDictionary>(name, memory_budget_, *spill_directory_);
+    dictionaries_.emplace(name, dictionary);
+    return dictionary;
+}
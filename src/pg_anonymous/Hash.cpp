@@ -0,0 +1,40 @@
+#include "pg_anonymous/Hash.hpp"
+#include "pg_anonymous/Kernels.hpp"
+
+namespace stable_hash
+{
+
+namespace
+{
+
+void hash_many_scalar(const std::string_view *values, size_t count, uint64_t seed, uint64_t *hashes)
+{
+    for (size_t i = 0; i < count; ++i)
+        hashes[i] = hash(values[i], seed);
+}
+
+/**
+ * @brief Whether a batch's value lengths vary enough that the scalar tail loop mispredicts its branches. Lanes
+ * step through every length in lockstep, so they only pay off there: on a column of equal-length ids the
+ * 64-bit multiply latency makes them slower than the scalar loop.
+ */
+bool irregular_lengths(const std::string_view *values, size_t count)
+{
+    size_t changes = 0;
+    for (size_t i = 1; i < count; ++i)
+        changes += values[i].size() != values[i - 1].size();
+    return 2 * changes > count;
+}
+
+} // namespace
+
+void hash_many(const std::string_view *values, size_t count, uint64_t seed, uint64_t *hashes)
+{
+    const KernelSet &kernels = active_kernels();
+    if (kernels.hash_lanes && (kernels.hash_lanes_always || irregular_lengths(values, count)))
+        kernels.hash_lanes(values, count, seed, hashes);
+    else
+        hash_many_scalar(values, count, seed, hashes);
+}
+
+} // namespace stable_hash
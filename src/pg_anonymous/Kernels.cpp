@@ -0,0 +1,473 @@
+#include "pg_anonymous/Kernels.hpp"
+#include "pg_anonymous/Hash.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PG_ANONYMOUS_X86_KERNELS
+#include <immintrin.h>
+#define PG_ANONYMOUS_SSE42 __attribute__((target("sse4.2")))
+#define PG_ANONYMOUS_AVX2 __attribute__((target("avx2")))
+#define PG_ANONYMOUS_AVX512 __attribute__((target("avx512f,avx512dq")))
+#define PG_ANONYMOUS_AVX512BW __attribute__((target("avx512f,avx512bw")))
+#elif defined(__aarch64__)
+#define PG_ANONYMOUS_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+
+using namespace stable_hash;
+
+// --- Tab Scanning ---
+
+size_t find_tabs_scalar(const char *data, size_t size, size_t *offsets, size_t max)
+{
+    size_t count = 0;
+    const char *end = data + size;
+    for (const char *p = data; count < max;)
+    {
+        p = static_cast<const char *>(std::memchr(p, '\t', static_cast<size_t>(end - p)));
+        if (!p)
+            break;
+        offsets[count++] = static_cast<size_t>(p - data);
+        ++p;
+    }
+    return count;
+}
+
+/**
+ * @brief Appends the offsets of the set bits of a block's compare mask (one bit per byte at `base`), stopping
+ * at `max`.
+ */
+inline size_t emit_offsets(uint64_t mask, size_t base, size_t *offsets, size_t count, size_t max)
+{
+    while (mask && count < max)
+    {
+        offsets[count++] = base + static_cast<size_t>(__builtin_ctzll(mask));
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+/** The bytes after the last whole vector block. */
+inline size_t find_tabs_tail(const char *data, size_t i, size_t size, size_t *offsets, size_t count, size_t max)
+{
+    for (; i < size && count < max; ++i)
+    {
+        if (data[i] == '\t')
+            offsets[count++] = i;
+    }
+    return count;
+}
+
+#ifdef PG_ANONYMOUS_X86_KERNELS
+
+PG_ANONYMOUS_SSE42 size_t find_tabs_sse42(const char *data, size_t size, size_t *offsets, size_t max)
+{
+    const __m128i tab = _mm_set1_epi8('\t');
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= size && count < max; i += 16)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, tab)));
+        count = emit_offsets(mask, i, offsets, count, max);
+    }
+    return find_tabs_tail(data, i, size, offsets, count, max);
+}
+
+PG_ANONYMOUS_AVX2 size_t find_tabs_avx2(const char *data, size_t size, size_t *offsets, size_t max)
+{
+    const __m256i tab = _mm256_set1_epi8('\t');
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 32 <= size && count < max; i += 32)
+    {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, tab)));
+        count = emit_offsets(mask, i, offsets, count, max);
+    }
+    return find_tabs_tail(data, i, size, offsets, count, max);
+}
+
+// The last partial block is read with a masked load, which does not touch the bytes past the end.
+PG_ANONYMOUS_AVX512BW size_t find_tabs_avx512(const char *data, size_t size, size_t *offsets, size_t max)
+{
+    const __m512i tab = _mm512_set1_epi8('\t');
+    size_t count = 0;
+    for (size_t i = 0; i < size && count < max; i += 64)
+    {
+        const size_t left = size - i;
+        const __mmask64 bytes = left >= 64 ? ~__mmask64(0) : (__mmask64(1) << left) - 1;
+        const __m512i block = _mm512_maskz_loadu_epi8(bytes, data + i);
+        count = emit_offsets(_mm512_mask_cmpeq_epi8_mask(bytes, block, tab), i, offsets, count, max);
+    }
+    return count;
+}
+
+// --- Hash Lanes ---
+
+// The lane kernels run hash_tail for values of 4 to 31 bytes, one value per 64-bit lane. Lanes load their words
+// with masked gathers straight from the values, and a lane takes a step only while its value has input left.
+// Single trailing bytes are read as the top byte of the 4 bytes ending at them, which is why values shorter than
+// 4 bytes (and values long enough for stripes) take the scalar path.
+constexpr size_t kMinLaneSize = 4;
+
+// AVX2: 4 lanes. No 64-bit multiply, so products are assembled from three 32x32->64 multiplies.
+
+struct Avx2Constant
+{
+    __m256i low;
+    __m256i high;
+};
+
+PG_ANONYMOUS_AVX2 inline Avx2Constant avx2_constant(uint64_t value)
+{
+    return {_mm256_set1_epi64x(static_cast<long long>(value & 0xFFFFFFFFULL)),
+            _mm256_set1_epi64x(static_cast<long long>(value >> 32))};
+}
+
+PG_ANONYMOUS_AVX2 inline __m256i avx2_mul(__m256i a, const Avx2Constant &b)
+{
+    const __m256i low = _mm256_mul_epu32(a, b.low);
+    const __m256i cross =
+        _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b.low), _mm256_mul_epu32(a, b.high));
+    return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+}
+
+template <int R> PG_ANONYMOUS_AVX2 inline __m256i avx2_rotl(__m256i x)
+{
+    return _mm256_or_si256(_mm256_slli_epi64(x, R), _mm256_srli_epi64(x, 64 - R));
+}
+
+PG_ANONYMOUS_AVX2 inline __m256i avx2_set(long long value)
+{
+    return _mm256_set1_epi64x(value);
+}
+
+// Gathers the 4 bytes at each lane's address (zero-extended) in the lanes selected by a 64-bit lane mask.
+PG_ANONYMOUS_AVX2 inline __m256i avx2_gather32(__m256i addresses, __m256i mask)
+{
+    const __m128i mask32 =
+        _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(mask, _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7)));
+    return _mm256_cvtepu32_epi64(
+        _mm256_mask_i64gather_epi32(_mm_setzero_si128(), static_cast<const int *>(nullptr), addresses, mask32, 1));
+}
+
+PG_ANONYMOUS_AVX2 void hash_lanes_avx2(const std::string_view *values, size_t count, uint64_t seed,
+                                       uint64_t *hashes)
+{
+    constexpr size_t L = 4;
+    const Avx2Constant p1 = avx2_constant(kPrime1), p2 = avx2_constant(kPrime2), p3 = avx2_constant(kPrime3),
+                       p5 = avx2_constant(kPrime5);
+    const __m256i add3 = avx2_set(static_cast<long long>(kPrime3));
+    const __m256i add4 = avx2_set(static_cast<long long>(kPrime4));
+    const __m256i initial = avx2_set(static_cast<long long>(seed + kPrime5));
+
+    for (size_t base = 0; base < count; base += L)
+    {
+        const size_t lanes = std::min(L, count - base);
+        // Built in registers: storing lanes to memory and reloading them as a vector would stall on store
+        // forwarding and serialize consecutive groups.
+        auto address = [&](size_t lane) {
+            return lane < lanes ? static_cast<long long>(reinterpret_cast<uintptr_t>(values[base + lane].data())) : 0;
+        };
+        auto size = [&](size_t lane) { return lane < lanes ? static_cast<long long>(values[base + lane].size()) : 0; };
+        const __m256i p = _mm256_set_epi64x(address(3), address(2), address(1), address(0));
+        const __m256i n = _mm256_set_epi64x(size(3), size(2), size(1), size(0));
+        const __m256i active = _mm256_and_si256(_mm256_cmpgt_epi64(avx2_set(kStripeSize), n),
+                                                _mm256_cmpgt_epi64(n, avx2_set(kMinLaneSize - 1)));
+        const __m256i words = _mm256_srli_epi64(n, 3);
+
+        __m256i h = _mm256_add_epi64(initial, avx2_mul(n, p1));
+        for (int k = 0; k < 3; ++k)
+        {
+            const __m256i mask = _mm256_and_si256(active, _mm256_cmpgt_epi64(words, avx2_set(k)));
+            if (_mm256_testz_si256(mask, mask))
+                break;
+            const __m256i word =
+                _mm256_mask_i64gather_epi64(_mm256_setzero_si256(), static_cast<const long long *>(nullptr),
+                                            _mm256_add_epi64(p, avx2_set(8 * k)), mask, 1);
+            __m256i t = avx2_mul(avx2_rotl<31>(avx2_mul(word, p2)), p1);
+            t = _mm256_add_epi64(avx2_mul(avx2_rotl<27>(_mm256_xor_si256(h, t)), p1), add4);
+            h = _mm256_blendv_epi8(h, t, mask);
+        }
+        __m256i offset = _mm256_slli_epi64(words, 3);
+        const __m256i mask32 =
+            _mm256_and_si256(active, _mm256_cmpeq_epi64(_mm256_and_si256(n, avx2_set(4)), avx2_set(4)));
+        if (!_mm256_testz_si256(mask32, mask32))
+        {
+            __m256i t = _mm256_xor_si256(h, avx2_mul(avx2_gather32(_mm256_add_epi64(p, offset), mask32), p1));
+            t = _mm256_add_epi64(avx2_mul(avx2_rotl<23>(t), p2), add3);
+            h = _mm256_blendv_epi8(h, t, mask32);
+            offset = _mm256_add_epi64(offset, _mm256_and_si256(mask32, avx2_set(4)));
+        }
+        const __m256i rest = _mm256_and_si256(n, avx2_set(3));
+        for (int k = 0; k < 3; ++k)
+        {
+            const __m256i mask = _mm256_and_si256(active, _mm256_cmpgt_epi64(rest, avx2_set(k)));
+            if (_mm256_testz_si256(mask, mask))
+                break;
+            const __m256i byte = _mm256_srli_epi64(
+                avx2_gather32(_mm256_add_epi64(p, _mm256_add_epi64(offset, avx2_set(k - 3))), mask), 24);
+            __m256i t = _mm256_xor_si256(h, avx2_mul(byte, p5));
+            t = avx2_mul(avx2_rotl<11>(t), p1);
+            h = _mm256_blendv_epi8(h, t, mask);
+        }
+        h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 33));
+        h = avx2_mul(h, p2);
+        h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 29));
+        h = avx2_mul(h, p3);
+        h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 32));
+
+        alignas(32) uint64_t out[L];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(out), h);
+        const int lane_mask = _mm256_movemask_pd(_mm256_castsi256_pd(active));
+        for (size_t lane = 0; lane < lanes; ++lane)
+            hashes[base + lane] = (lane_mask >> lane) & 1 ? out[lane] : hash(values[base + lane], seed);
+    }
+}
+
+// AVX-512: 8 lanes, native 64-bit multiplies and rotates, masked instead of blended updates.
+
+PG_ANONYMOUS_AVX512 inline __m512i avx512_set(long long value)
+{
+    return _mm512_set1_epi64(value);
+}
+
+PG_ANONYMOUS_AVX512 inline __m512i avx512_gather32(__m512i addresses, __mmask8 mask)
+{
+    return _mm512_cvtepu32_epi64(_mm512_mask_i64gather_epi32(_mm256_setzero_si256(), mask, addresses, nullptr, 1));
+}
+
+PG_ANONYMOUS_AVX512 void hash_lanes_avx512(const std::string_view *values, size_t count, uint64_t seed,
+                                           uint64_t *hashes)
+{
+    constexpr size_t L = 8;
+    const __m512i p1 = avx512_set(static_cast<long long>(kPrime1));
+    const __m512i p2 = avx512_set(static_cast<long long>(kPrime2));
+    const __m512i p3 = avx512_set(static_cast<long long>(kPrime3));
+    const __m512i p4 = avx512_set(static_cast<long long>(kPrime4));
+    const __m512i p5 = avx512_set(static_cast<long long>(kPrime5));
+    const __m512i initial = avx512_set(static_cast<long long>(seed + kPrime5));
+
+    for (size_t base = 0; base < count; base += L)
+    {
+        const size_t lanes = std::min(L, count - base);
+        auto address = [&](size_t lane) {
+            return lane < lanes ? static_cast<long long>(reinterpret_cast<uintptr_t>(values[base + lane].data())) : 0;
+        };
+        auto size = [&](size_t lane) { return lane < lanes ? static_cast<long long>(values[base + lane].size()) : 0; };
+        const __m512i p = _mm512_set_epi64(address(7), address(6), address(5), address(4), address(3), address(2),
+                                           address(1), address(0));
+        const __m512i n =
+            _mm512_set_epi64(size(7), size(6), size(5), size(4), size(3), size(2), size(1), size(0));
+        const __mmask8 active = _mm512_cmplt_epu64_mask(n, avx512_set(kStripeSize)) &
+                                _mm512_cmpge_epu64_mask(n, avx512_set(kMinLaneSize));
+        const __m512i words = _mm512_srli_epi64(n, 3);
+
+        __m512i h = _mm512_add_epi64(initial, _mm512_mullo_epi64(n, p1));
+        for (int k = 0; k < 3; ++k)
+        {
+            const __mmask8 mask = active & _mm512_cmpgt_epu64_mask(words, avx512_set(k));
+            if (!mask)
+                break;
+            const __m512i word = _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), mask,
+                                                             _mm512_add_epi64(p, avx512_set(8 * k)), nullptr, 1);
+            __m512i t = _mm512_mullo_epi64(_mm512_rol_epi64(_mm512_mullo_epi64(word, p2), 31), p1);
+            t = _mm512_add_epi64(_mm512_mullo_epi64(_mm512_rol_epi64(_mm512_xor_si512(h, t), 27), p1), p4);
+            h = _mm512_mask_mov_epi64(h, mask, t);
+        }
+        __m512i offset = _mm512_slli_epi64(words, 3);
+        const __mmask8 mask32 = active & _mm512_test_epi64_mask(n, avx512_set(4));
+        if (mask32)
+        {
+            const __m512i word = avx512_gather32(_mm512_add_epi64(p, offset), mask32);
+            __m512i t = _mm512_xor_si512(h, _mm512_mullo_epi64(word, p1));
+            t = _mm512_add_epi64(_mm512_mullo_epi64(_mm512_rol_epi64(t, 23), p2), p3);
+            h = _mm512_mask_mov_epi64(h, mask32, t);
+            offset = _mm512_mask_add_epi64(offset, mask32, offset, avx512_set(4));
+        }
+        const __m512i rest = _mm512_and_si512(n, avx512_set(3));
+        for (int k = 0; k < 3; ++k)
+        {
+            const __mmask8 mask = active & _mm512_cmpgt_epu64_mask(rest, avx512_set(k));
+            if (!mask)
+                break;
+            const __m512i byte = _mm512_srli_epi64(
+                avx512_gather32(_mm512_add_epi64(p, _mm512_add_epi64(offset, avx512_set(k - 3))), mask), 24);
+            __m512i t = _mm512_xor_si512(h, _mm512_mullo_epi64(byte, p5));
+            t = _mm512_mullo_epi64(_mm512_rol_epi64(t, 11), p1);
+            h = _mm512_mask_mov_epi64(h, mask, t);
+        }
+        h = _mm512_xor_si512(h, _mm512_srli_epi64(h, 33));
+        h = _mm512_mullo_epi64(h, p2);
+        h = _mm512_xor_si512(h, _mm512_srli_epi64(h, 29));
+        h = _mm512_mullo_epi64(h, p3);
+        h = _mm512_xor_si512(h, _mm512_srli_epi64(h, 32));
+
+        _mm512_mask_storeu_epi64(hashes + base, active, h);
+        for (size_t lane = 0; lane < lanes; ++lane)
+        {
+            if (!((active >> lane) & 1))
+                hashes[base + lane] = hash(values[base + lane], seed);
+        }
+    }
+}
+
+#endif // PG_ANONYMOUS_X86_KERNELS
+
+#ifdef PG_ANONYMOUS_NEON_KERNELS
+
+// NEON has no movemask; narrowing the compare result by 4 bits leaves a 64-bit mask with a nibble per byte.
+size_t find_tabs_neon(const char *data, size_t size, size_t *offsets, size_t max)
+{
+    const uint8x16_t tab = vdupq_n_u8('\t');
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= size && count < max; i += 16)
+    {
+        const uint8x16_t matches = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t *>(data + i)), tab);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+        while (mask && count < max)
+        {
+            const unsigned bit = static_cast<unsigned>(__builtin_ctzll(mask));
+            offsets[count++] = i + bit / 4;
+            mask &= ~(0xFULL << (bit & ~3u));
+        }
+    }
+    return find_tabs_tail(data, i, size, offsets, count, max);
+}
+
+#endif // PG_ANONYMOUS_NEON_KERNELS
+
+// --- Selection ---
+
+bool cpu_supports(KernelLevel level)
+{
+#ifdef PG_ANONYMOUS_X86_KERNELS
+    __builtin_cpu_init();
+#endif
+    switch (level)
+    {
+    case KernelLevel::Scalar:
+        return true;
+#ifdef PG_ANONYMOUS_X86_KERNELS
+    case KernelLevel::Sse42:
+        return __builtin_cpu_supports("sse4.2");
+    case KernelLevel::Avx2:
+        return __builtin_cpu_supports("avx2");
+    case KernelLevel::Avx512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+               __builtin_cpu_supports("avx512dq");
+#endif
+#ifdef PG_ANONYMOUS_NEON_KERNELS
+    case KernelLevel::Neon:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief The kernels of a level. Auto-detection leaves out the hash lanes where they measured slower than the
+ * scalar loop (AVX2) and gates the AVX-512 ones on the batch's lengths; a forced level always uses them.
+ */
+KernelSet kernels_for(KernelLevel level, bool forced)
+{
+    KernelSet kernels{level, find_tabs_scalar};
+    switch (level)
+    {
+#ifdef PG_ANONYMOUS_X86_KERNELS
+    case KernelLevel::Sse42:
+        kernels.find_tabs = find_tabs_sse42;
+        break;
+    case KernelLevel::Avx2:
+        kernels.find_tabs = find_tabs_avx2;
+        if (forced)
+            kernels.hash_lanes = hash_lanes_avx2;
+        break;
+    case KernelLevel::Avx512:
+        kernels.find_tabs = find_tabs_avx512;
+        kernels.hash_lanes = hash_lanes_avx512;
+        break;
+#endif
+#ifdef PG_ANONYMOUS_NEON_KERNELS
+    case KernelLevel::Neon:
+        kernels.find_tabs = find_tabs_neon;
+        break;
+#endif
+    default:
+        break;
+    }
+    kernels.hash_lanes_always = forced;
+    return kernels;
+}
+
+KernelSet &current_kernels()
+{
+    static KernelSet kernels = kernels_for(supported_kernel_levels().back(), false);
+    return kernels;
+}
+
+constexpr KernelLevel kAllLevels[] = {KernelLevel::Scalar, KernelLevel::Sse42, KernelLevel::Avx2, KernelLevel::Avx512,
+                                      KernelLevel::Neon};
+
+} // namespace
+
+const KernelSet &active_kernels()
+{
+    return current_kernels();
+}
+
+bool select_kernels(std::string_view name)
+{
+    if (name == "auto")
+    {
+        current_kernels() = kernels_for(supported_kernel_levels().back(), false);
+        return true;
+    }
+    for (KernelLevel level : kAllLevels)
+    {
+        if (kernel_level_name(level) == name)
+        {
+            if (!cpu_supports(level))
+                return false;
+            current_kernels() = kernels_for(level, true);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<KernelLevel> supported_kernel_levels()
+{
+    std::vector<KernelLevel> levels;
+    for (KernelLevel level : kAllLevels)
+    {
+        if (cpu_supports(level))
+            levels.push_back(level);
+    }
+    return levels;
+}
+
+std::string_view kernel_level_name(KernelLevel level)
+{
+    switch (level)
+    {
+    case KernelLevel::Scalar:
+        return "scalar";
+    case KernelLevel::Sse42:
+        return "sse4.2";
+    case KernelLevel::Avx2:
+        return "avx2";
+    case KernelLevel::Avx512:
+        return "avx512";
+    case KernelLevel::Neon:
+        return "neon";
+    }
+    return "unknown";
+}
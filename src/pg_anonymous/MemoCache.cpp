@@ -0,0 +1,144 @@
+#include "pg_anonymous/MemoCache.hpp"
+
+#include <utility>
+
+namespace
+{
+
+constexpr size_t kInitialSlots = 16;
+
+} // namespace
+
+MemoCache::MemoCache(size_t byte_budget) : budget_(byte_budget)
+{
+    if (budget_ < kInitialSlots * sizeof(Entry))
+        stats_.disabled = true;
+    else
+        slots_.resize(kInitialSlots);
+}
+
+const std::string *MemoCache::find(std::string_view key, uint64_t hash)
+{
+    ++stats_.lookups;
+    if (++window_lookups_ == kWindow)
+        end_window();
+    if (stats_.disabled)
+        return nullptr;
+
+    const size_t mask = slots_.size() - 1;
+    for (size_t slot = hash & mask; slots_[slot].used; slot = (slot + 1) & mask)
+    {
+        Entry &entry = slots_[slot];
+        if (entry.hash == hash && entry.key == key)
+        {
+            entry.referenced = true;
+            ++stats_.hits;
+            ++window_hits_;
+            return &entry.value;
+        }
+    }
+    return nullptr;
+}
+
+void MemoCache::insert(std::string_view key, uint64_t hash, std::string value)
+{
+    if (stats_.disabled)
+        return;
+
+    Entry entry{hash, std::string(key), std::move(value), true, false};
+    const size_t bytes = entry_bytes(entry);
+    if (bytes > budget_ / 4)
+        return; // one oversized value must not flush the whole cache
+
+    // Keep the load factor at or below 1/2: grow while the larger slot array still fits the budget, evict after.
+    if (2 * (count_ + 1) > slots_.size())
+    {
+        if (2 * slots_.size() * sizeof(Entry) + bytes_ + bytes <= budget_)
+            grow();
+        else
+            evict_one();
+    }
+    while (count_ > 0 && slots_.size() * sizeof(Entry) + bytes_ + bytes > budget_)
+        evict_one();
+
+    const size_t mask = slots_.size() - 1;
+    size_t slot = hash & mask;
+    while (slots_[slot].used)
+        slot = (slot + 1) & mask;
+    slots_[slot] = std::move(entry);
+    ++count_;
+    bytes_ += bytes;
+}
+
+void MemoCache::grow()
+{
+    std::vector<Entry> old = std::move(slots_);
+    slots_.clear();
+    slots_.resize(old.size() * 2);
+    const size_t mask = slots_.size() - 1;
+    for (Entry &entry : old)
+    {
+        if (!entry.used)
+            continue;
+        size_t slot = entry.hash & mask;
+        while (slots_[slot].used)
+            slot = (slot + 1) & mask;
+        slots_[slot] = std::move(entry);
+    }
+    hand_ = 0;
+}
+
+void MemoCache::evict_one()
+{
+    // CLOCK: sweep the slots, giving recently hit entries a second chance.
+    const size_t mask = slots_.size() - 1;
+    for (;;)
+    {
+        Entry &entry = slots_[hand_];
+        if (entry.used)
+        {
+            if (!entry.referenced)
+            {
+                erase(hand_);
+                ++stats_.evictions;
+                return;
+            }
+            entry.referenced = false;
+        }
+        hand_ = (hand_ + 1) & mask;
+    }
+}
+
+void MemoCache::erase(size_t slot)
+{
+    bytes_ -= entry_bytes(slots_[slot]);
+    --count_;
+    slots_[slot] = Entry{};
+
+    // Backward-shift deletion: pull later entries of the probe run into the hole so lookups never stop early.
+    const size_t mask = slots_.size() - 1;
+    for (size_t next = (slot + 1) & mask; slots_[next].used; next = (next + 1) & mask)
+    {
+        const size_t home = slots_[next].hash & mask;
+        const bool movable = slot <= next ? (home <= slot || home > next) : (home <= slot && home > next);
+        if (movable)
+        {
+            slots_[slot] = std::move(slots_[next]);
+            slots_[next] = Entry{};
+            slot = next;
+        }
+    }
+}
+
+void MemoCache::end_window()
+{
+    if (!stats_.disabled && double(window_hits_) < kMinHitRate * double(window_lookups_))
+    {
+        stats_.disabled = true;
+        std::vector<Entry>().swap(slots_);
+        count_ = 0;
+        bytes_ = 0;
+    }
+    window_lookups_ = 0;
+    window_hits_ = 0;
+}
@@ -0,0 +1,129 @@
+#include "pg_anonymous/Numeric.hpp"
+
+#include <charconv>
+#include <cmath>
+
+namespace
+{
+
+constexpr __int128 power_of_ten(unsigned exponent)
+{
+    __int128 power = 1;
+    while (exponent-- > 0)
+        power *= 10;
+    return power;
+}
+
+constexpr __int128 kMaxUnits = power_of_ten(DecimalText::kMaxDigits);
+
+} // namespace
+
+bool DecimalText::parse(std::string_view text, DecimalText &value)
+{
+    size_t pos = 0;
+    const bool negative = !text.empty() && text[0] == '-';
+    if (negative || (!text.empty() && text[0] == '+'))
+        ++pos;
+
+    __int128 units = 0;
+    unsigned digits = 0, significant = 0, scale = 0;
+    bool seen_point = false;
+    for (; pos < text.size(); ++pos)
+    {
+        const char c = text[pos];
+        if (c == '.' && !seen_point)
+        {
+            seen_point = true;
+            continue;
+        }
+        if (c < '0' || c > '9')
+            return false;
+        ++digits;
+        significant += units != 0 || c != '0'; // leading zeros do not count against the limit
+        if (significant > kMaxDigits)
+            return false;
+        units = units * 10 + (c - '0');
+        scale += seen_point;
+        if (scale > kMaxDigits) // keeps power_of_ten(scale) and format() in range
+            return false;
+    }
+    if (digits == 0)
+        return false;
+
+    value.units = negative ? -units : units;
+    value.scale = scale;
+    return true;
+}
+
+void DecimalText::format(std::string &out) const
+{
+    // An __int128 has at most 39 digits and parse() caps scale below that, so 40 bytes hold the digits and the point.
+    static_assert(kMaxDigits < 39);
+    unsigned __int128 magnitude = units < 0 ? -static_cast<unsigned __int128>(units) : units;
+    char digits[40];
+    char *end = digits + sizeof(digits);
+    char *begin = end;
+    for (unsigned written = 0; magnitude != 0 || written <= scale; ++written)
+    {
+        if (written == scale && scale > 0)
+            *--begin = '.';
+        *--begin = static_cast<char>('0' + static_cast<unsigned>(magnitude % 10));
+        magnitude /= 10;
+    }
+    if (units < 0)
+        out += '-';
+    out.append(begin, end);
+}
+
+bool DecimalText::rescale(unsigned new_scale)
+{
+    if (new_scale >= scale)
+    {
+        if (new_scale - scale > kMaxDigits)
+            return false;
+        const __int128 factor = power_of_ten(new_scale - scale);
+        if ((units < 0 ? -units : units) > kMaxUnits / factor)
+            return false;
+        units *= factor;
+    }
+    else
+    {
+        const __int128 factor = power_of_ten(scale - new_scale);
+        const __int128 remainder = units % factor;
+        units /= factor;
+        if (2 * (remainder < 0 ? -remainder : remainder) >= factor)
+            units += remainder < 0 ? -1 : 1;
+    }
+    scale = new_scale;
+    return true;
+}
+
+long double DecimalText::to_long_double() const
+{
+    return static_cast<long double>(units) / static_cast<long double>(power_of_ten(scale));
+}
+
+int compare_decimals(DecimalText a, DecimalText b)
+{
+    const unsigned scale = a.scale > b.scale ? a.scale : b.scale;
+    if (!a.rescale(scale) || !b.rescale(scale))
+    {
+        const long double x = a.to_long_double(), y = b.to_long_double();
+        return (x > y) - (x < y);
+    }
+    return (a.units > b.units) - (a.units < b.units);
+}
+
+bool parse_float(std::string_view text, double &value)
+{
+    const char *first = text.data() + (!text.empty() && text[0] == '+' ? 1 : 0);
+    auto [end, ec] = std::from_chars(first, text.data() + text.size(), value);
+    return ec == std::errc() && end == text.data() + text.size() && std::isfinite(value);
+}
+
+void format_float(double value, std::string &out)
+{
+    char digits[32];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
@@ -0,0 +1,149 @@
+#include "pg_anonymous/ParallelExecutor.hpp"
+
+#include <utility>
+
+ParallelExecutor::Worker::Worker(const ExecutionLayout &layout, size_t batch_rows) : execution(layout)
+{
+    if (batch_rows > 0)
+        batch.emplace(batch_rows);
+}
+
+ParallelExecutor::ParallelExecutor(size_t threads, size_t batch_rows, const ExecutionLayout &layout)
+{
+    threads = threads > 0 ? threads : 1;
+    chunk_.resize(threads * kRowsPerThread);
+    running_.resize(chunk_.size());
+    for (size_t i = 0; i < threads; ++i)
+        workers_.push_back(std::make_unique<Worker>(layout, batch_rows));
+    for (auto &worker : workers_)
+        worker->thread = std::thread(&ParallelExecutor::run, this, std::ref(*worker));
+}
+
+ParallelExecutor::~ParallelExecutor()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    start_.notify_all();
+    for (auto &worker : workers_)
+        worker->thread.join();
+}
+
+void ParallelExecutor::begin(const RowSlots &slots, const std::vector<size_t> &slot_indices,
+                             const std::vector<const IRule *> &column_rules)
+{
+    chunk_ordinal_ = 0;
+    for (auto &worker : workers_)
+    {
+        worker->rows.begin(slots, slot_indices, column_rules, worker->execution);
+        if (worker->batch)
+            worker->batch->begin(slots, slot_indices, column_rules, worker->execution);
+    }
+}
+
+void ParallelExecutor::push(std::string &line, std::ostream &out)
+{
+    chunk_[chunk_rows_++].swap(line);
+    if (chunk_rows_ == chunk_.size())
+        dispatch(out);
+}
+
+void ParallelExecutor::flush(std::ostream &out)
+{
+    if (chunk_rows_ > 0)
+        dispatch(out);
+    collect(out);
+}
+
+std::vector<const ExecutionContext *> ParallelExecutor::contexts() const
+{
+    std::vector<const ExecutionContext *> contexts;
+    for (const auto &worker : workers_)
+        contexts.push_back(&worker->execution);
+    return contexts;
+}
+
+void ParallelExecutor::dispatch(std::ostream &out)
+{
+    collect(out);
+
+    chunk_.swap(running_);
+    running_rows_ = std::exchange(chunk_rows_, 0);
+    running_ordinal_ = chunk_ordinal_;
+    chunk_ordinal_ += running_rows_;
+
+    const size_t threads = workers_.size();
+    for (size_t i = 0; i < threads; ++i)
+    {
+        workers_[i]->first = running_rows_ * i / threads;
+        workers_[i]->last = running_rows_ * (i + 1) / threads;
+    }
+    {
+        std::lock_guard lock(mutex_);
+        pending_ = threads;
+        ++generation_;
+    }
+    start_.notify_all();
+    in_flight_ = true;
+}
+
+void ParallelExecutor::collect(std::ostream &out)
+{
+    if (!in_flight_)
+        return;
+    {
+        std::unique_lock lock(mutex_);
+        done_.wait(lock, [&] { return pending_ == 0; });
+    }
+    in_flight_ = false;
+
+    if (error_)
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    for (const auto &worker : workers_)
+        out << worker->output;
+}
+
+void ParallelExecutor::run(Worker &worker)
+{
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock lock(mutex_);
+            start_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+            if (stopping_)
+                return;
+            seen = generation_;
+        }
+
+        try
+        {
+            transform(worker);
+        }
+        catch (...)
+        {
+            std::lock_guard lock(mutex_);
+            if (!error_)
+                error_ = std::current_exception();
+        }
+
+        std::lock_guard lock(mutex_);
+        if (--pending_ == 0)
+            done_.notify_one();
+    }
+}
+
+void ParallelExecutor::transform(Worker &worker)
+{
+    worker.output.clear();
+    for (size_t row = worker.first; row < worker.last; ++row)
+    {
+        if (worker.batch)
+            worker.batch->push(running_[row], running_ordinal_ + row, worker.output);
+        else
+            worker.rows.transform(running_[row], running_ordinal_ + row, worker.output);
+    }
+    if (worker.batch)
+        worker.batch->flush(worker.output);
+}
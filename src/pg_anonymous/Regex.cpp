@@ -0,0 +1,1611 @@
+#include "pg_anonymous/Regex.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <regex>
+
+namespace
+{
+
+// Syntax the linear-time engine cannot express. Automatic mode falls back to std::regex on it.
+class UnsupportedSyntax : public RegexError
+{
+  public:
+    using RegexError::RegexError;
+};
+
+constexpr size_t kMaxInstructions = 1 << 16;
+// Subjects whose (instruction x position) visited bitmap fits in this many bits use the bounded backtracker.
+constexpr size_t kMaxBacktrackBits = 256 * 1024;
+constexpr int kMaxRepeat = 1000;
+
+// --- Byte Sets ---
+
+using ByteSet = std::array<uint64_t, 4>;
+
+void add_byte(ByteSet &set, unsigned char c)
+{
+    set[c >> 6] |= uint64_t(1) << (c & 63);
+}
+
+void add_range(ByteSet &set, unsigned char lo, unsigned char hi)
+{
+    for (unsigned c = lo; c <= hi; ++c)
+        add_byte(set, static_cast<unsigned char>(c));
+}
+
+bool has_byte(const ByteSet &set, unsigned char c)
+{
+    return (set[c >> 6] >> (c & 63)) & 1;
+}
+
+void merge(ByteSet &into, const ByteSet &from)
+{
+    for (size_t i = 0; i < into.size(); ++i)
+        into[i] |= from[i];
+}
+
+void invert(ByteSet &set)
+{
+    for (auto &word : set)
+        word = ~word;
+}
+
+bool is_word_byte(unsigned char c)
+{
+    return std::isalnum(c) || c == '_';
+}
+
+// --- Syntax Tree ---
+
+enum class AssertKind
+{
+    LineStart,
+    LineEnd,
+    WordBoundary,
+    NotWordBoundary
+};
+
+struct Node
+{
+    enum class Kind
+    {
+        Bytes,
+        Concat,
+        Alternate,
+        Repeat,
+        Group,
+        Assert
+    };
+
+    Kind kind;
+    ByteSet bytes{};
+    int min = 0, max = 0; // Repeat bounds; max < 0 means unbounded
+    bool greedy = true;
+    int capture = 0;
+    AssertKind assertion = AssertKind::LineStart;
+    std::vector<std::unique_ptr<Node>> children;
+
+    explicit Node(Kind k) : kind(k)
+    {
+    }
+};
+
+/**
+ * @brief Recursive-descent parser for the ECMAScript subset the NFA engine supports.
+ */
+class Parser
+{
+    std::string_view pattern_;
+    size_t pos_ = 0;
+    int captures_ = 0;
+
+  public:
+    explicit Parser(std::string_view pattern) : pattern_(pattern)
+    {
+    }
+
+    std::unique_ptr<Node> parse()
+    {
+        auto root = parse_alternation();
+        if (pos_ != pattern_.size())
+            fail("unmatched ')'");
+        return root;
+    }
+
+    int capture_count() const
+    {
+        return captures_;
+    }
+
+  private:
+    bool at_end() const
+    {
+        return pos_ >= pattern_.size();
+    }
+
+    char peek() const
+    {
+        return pattern_[pos_];
+    }
+
+    [[noreturn]] void fail(const std::string &what) const
+    {
+        throw RegexError(what + " at offset " + std::to_string(pos_));
+    }
+
+    std::unique_ptr<Node> parse_alternation()
+    {
+        auto first = parse_concat();
+        if (at_end() || peek() != '|')
+            return first;
+
+        auto alternate = std::make_unique<Node>(Node::Kind::Alternate);
+        alternate->children.push_back(std::move(first));
+        while (!at_end() && peek() == '|')
+        {
+            ++pos_;
+            alternate->children.push_back(parse_concat());
+        }
+        return alternate;
+    }
+
+    std::unique_ptr<Node> parse_concat()
+    {
+        auto concat = std::make_unique<Node>(Node::Kind::Concat);
+        while (!at_end() && peek() != '|' && peek() != ')')
+            concat->children.push_back(parse_repeat());
+        return concat;
+    }
+
+    std::unique_ptr<Node> parse_repeat()
+    {
+        auto atom = parse_atom();
+        if (at_end())
+            return atom;
+
+        int min = 0, max = 0;
+        char c = peek();
+        if (c == '*')
+            min = 0, max = -1, ++pos_;
+        else if (c == '+')
+            min = 1, max = -1, ++pos_;
+        else if (c == '?')
+            min = 0, max = 1, ++pos_;
+        else if (c != '{' || !parse_bounds(min, max))
+            return atom;
+
+        if (atom->kind == Node::Kind::Assert)
+            fail("nothing to repeat");
+
+        auto repeat = std::make_unique<Node>(Node::Kind::Repeat);
+        repeat->min = min;
+        repeat->max = max;
+        if (!at_end() && peek() == '?')
+        {
+            repeat->greedy = false;
+            ++pos_;
+        }
+        repeat->children.push_back(std::move(atom));
+        return repeat;
+    }
+
+    /**
+     * @brief Parses {n}, {n,} or {n,m} at the cursor. Anything else leaves the cursor on a literal '{'.
+     */
+    bool parse_bounds(int &min, int &max)
+    {
+        size_t i = pos_ + 1;
+        auto read_int = [&](int &value) {
+            size_t start = i;
+            value = 0;
+            while (i < pattern_.size() && std::isdigit(static_cast<unsigned char>(pattern_[i])) && value <= kMaxRepeat)
+                value = value * 10 + (pattern_[i++] - '0');
+            return i > start;
+        };
+
+        if (!read_int(min))
+            return false;
+        max = min;
+        if (i < pattern_.size() && pattern_[i] == ',')
+        {
+            ++i;
+            if (!read_int(max))
+                max = -1;
+        }
+        if (i >= pattern_.size() || pattern_[i] != '}')
+            return false;
+
+        pos_ = i + 1;
+        if (min > kMaxRepeat || max > kMaxRepeat)
+            fail("repetition count too large");
+        if (max >= 0 && max < min)
+            fail("invalid repetition range");
+        return true;
+    }
+
+    std::unique_ptr<Node> parse_atom()
+    {
+        char c = pattern_[pos_++];
+        switch (c)
+        {
+        case '(': {
+            int capture = -1;
+            if (pattern_.substr(pos_, 2) == "?:")
+                pos_ += 2;
+            else if (!at_end() && peek() == '?')
+                throw UnsupportedSyntax("lookaround");
+            else
+                capture = ++captures_;
+
+            auto inner = parse_alternation();
+            if (at_end() || peek() != ')')
+                fail("unmatched '('");
+            ++pos_;
+            if (capture < 0)
+                return inner;
+
+            auto group = std::make_unique<Node>(Node::Kind::Group);
+            group->capture = capture;
+            group->children.push_back(std::move(inner));
+            return group;
+        }
+        case '[':
+            return parse_class();
+        case '.': {
+            auto any = std::make_unique<Node>(Node::Kind::Bytes);
+            add_range(any->bytes, 0, 255);
+            any->bytes[0] &= ~((uint64_t(1) << '\n') | (uint64_t(1) << '\r'));
+            return any;
+        }
+        case '^':
+            return make_assert(AssertKind::LineStart);
+        case '$':
+            return make_assert(AssertKind::LineEnd);
+        case '\\':
+            return parse_escape();
+        case '*':
+        case '+':
+        case '?':
+            --pos_;
+            fail("nothing to repeat");
+        case '{': {
+            int min, max;
+            --pos_;
+            if (parse_bounds(min, max))
+                fail("nothing to repeat");
+            ++pos_;
+            break;
+        }
+        default:
+            break;
+        }
+        return make_byte(static_cast<unsigned char>(c));
+    }
+
+    static std::unique_ptr<Node> make_byte(unsigned char c)
+    {
+        auto node = std::make_unique<Node>(Node::Kind::Bytes);
+        add_byte(node->bytes, c);
+        return node;
+    }
+
+    static std::unique_ptr<Node> make_assert(AssertKind kind)
+    {
+        auto node = std::make_unique<Node>(Node::Kind::Assert);
+        node->assertion = kind;
+        return node;
+    }
+
+    std::unique_ptr<Node> parse_escape()
+    {
+        if (at_end())
+            fail("trailing backslash");
+
+        char c = peek();
+        if (c == 'b' || c == 'B')
+        {
+            ++pos_;
+            return make_assert(c == 'b' ? AssertKind::WordBoundary : AssertKind::NotWordBoundary);
+        }
+        if (c >= '1' && c <= '9')
+            throw UnsupportedSyntax("backreferences");
+
+        auto node = std::make_unique<Node>(Node::Kind::Bytes);
+        parse_escape_bytes(node->bytes);
+        return node;
+    }
+
+    /**
+     * @brief Parses the escape after a backslash into `set`.
+     * @return true when the escape denotes a single byte (usable as a range endpoint).
+     */
+    bool parse_escape_bytes(ByteSet &set, unsigned char *single = nullptr)
+    {
+        if (at_end())
+            fail("trailing backslash");
+
+        char c = pattern_[pos_++];
+        ByteSet cls{};
+        switch (c)
+        {
+        case 'd':
+        case 'D':
+            add_range(cls, '0', '9');
+            break;
+        case 'w':
+        case 'W':
+            add_range(cls, '0', '9');
+            add_range(cls, 'a', 'z');
+            add_range(cls, 'A', 'Z');
+            add_byte(cls, '_');
+            break;
+        case 's':
+        case 'S':
+            for (unsigned char ws : {' ', '\t', '\n', '\r', '\f', '\v'})
+                add_byte(cls, ws);
+            break;
+        default: {
+            unsigned char byte = escaped_byte(c);
+            add_byte(set, byte);
+            if (single)
+                *single = byte;
+            return true;
+        }
+        }
+
+        if (std::isupper(static_cast<unsigned char>(c)))
+            invert(cls);
+        merge(set, cls);
+        return false;
+    }
+
+    unsigned char escaped_byte(char c)
+    {
+        switch (c)
+        {
+        case 'f':
+            return '\f';
+        case 'n':
+            return '\n';
+        case 'r':
+            return '\r';
+        case 't':
+            return '\t';
+        case 'v':
+            return '\v';
+        case '0':
+            return '\0';
+        case 'b':
+            return '\b'; // only reachable inside a class
+        case 'c':
+            if (at_end() || !std::isalpha(static_cast<unsigned char>(peek())))
+                fail("invalid control escape");
+            return static_cast<unsigned char>(pattern_[pos_++] & 31);
+        case 'x':
+            return static_cast<unsigned char>(read_hex(2));
+        case 'u': {
+            unsigned value = read_hex(4);
+            if (value > 0xFF)
+                throw UnsupportedSyntax("\\u escapes above \\xFF");
+            return static_cast<unsigned char>(value);
+        }
+        default:
+            if (c >= '1' && c <= '9')
+                throw UnsupportedSyntax("backreferences");
+            return static_cast<unsigned char>(c);
+        }
+    }
+
+    unsigned read_hex(int digits)
+    {
+        unsigned value = 0;
+        for (int i = 0; i < digits; ++i)
+        {
+            if (at_end() || !std::isxdigit(static_cast<unsigned char>(peek())))
+                fail("invalid hex escape");
+            char h = pattern_[pos_++];
+            value = value * 16 + (std::isdigit(static_cast<unsigned char>(h)) ? h - '0' : (std::tolower(h) - 'a' + 10));
+        }
+        return value;
+    }
+
+    std::unique_ptr<Node> parse_class()
+    {
+        auto node = std::make_unique<Node>(Node::Kind::Bytes);
+        bool negate = !at_end() && peek() == '^';
+        if (negate)
+            ++pos_;
+
+        while (true)
+        {
+            if (at_end())
+                fail("unterminated character class");
+            char c = pattern_[pos_++];
+            if (c == ']')
+                break;
+
+            unsigned char lo = static_cast<unsigned char>(c);
+            if (c == '\\' && !parse_escape_bytes(node->bytes, &lo))
+                continue; // \d, \w, \s and friends cannot start a range
+
+            if (pos_ + 1 < pattern_.size() && peek() == '-' && pattern_[pos_ + 1] != ']')
+            {
+                ++pos_;
+                unsigned char hi = static_cast<unsigned char>(pattern_[pos_++]);
+                if (hi == '\\' && !parse_escape_bytes(node->bytes, &hi))
+                    fail("invalid range in character class");
+                if (hi < lo)
+                    fail("invalid range in character class");
+                add_range(node->bytes, lo, hi);
+            }
+            else
+            {
+                add_byte(node->bytes, lo);
+            }
+        }
+
+        if (negate)
+            invert(node->bytes);
+        return node;
+    }
+};
+
+// --- Program ---
+
+struct Inst
+{
+    enum class Op : uint8_t
+    {
+        Bytes,
+        Split,
+        Jmp,
+        Save,
+        Assert,
+        Match
+    };
+
+    Op op;
+    uint32_t x = 0, y = 0;
+};
+
+struct Program
+{
+    std::vector<Inst> insts;
+    std::vector<ByteSet> sets;
+    size_t capture_slots = 0;
+};
+
+// --- Prefilter ---
+
+/**
+ * @brief Facts every match must satisfy, extracted from the syntax tree so rows that cannot match are rejected
+ * with a length check and a memchr-based substring search before the engine runs.
+ */
+struct Prefilter
+{
+    size_t min_length = 0;
+    std::string required; // a literal contained in every match
+    std::string prefix;   // a literal every match starts with
+    bool anchored_start = false;
+
+    static Prefilter analyze(const Node &root)
+    {
+        Prefilter prefilter;
+        prefilter.min_length = min_length_of(root);
+        prefilter.required = required_literal(root);
+        prefilter.anchored_start = starts_anchored(root);
+        collect_prefix(root, prefilter.prefix);
+        return prefilter;
+    }
+
+    /**
+     * @brief False when no match can start at or after `start` (`whole`: the match must span the subject).
+     */
+    bool may_match(std::string_view subject, size_t start, bool whole) const
+    {
+        if (subject.size() - start < min_length)
+            return false;
+        if ((whole || anchored_start) && !subject.substr(start).starts_with(prefix))
+            return false;
+        if (anchored_start && start > 0)
+            return false;
+        // The prefix was checked in place above; otherwise a match can start anywhere, so search for the longer
+        // of the two literals.
+        if (required.size() <= prefix.size())
+            return whole || anchored_start || prefix.empty() || contains(subject.substr(start), prefix);
+        return contains(subject.substr(start), required);
+    }
+
+  private:
+    static bool contains(std::string_view haystack, std::string_view needle)
+    {
+        if (needle.size() == 1)
+            return std::memchr(haystack.data(), needle[0], haystack.size()) != nullptr;
+        return haystack.find(needle) != std::string_view::npos;
+    }
+
+    static bool single_byte(const Node &node, char &byte)
+    {
+        if (node.kind != Node::Kind::Bytes)
+            return false;
+        int count = 0;
+        for (size_t i = 0; i < node.bytes.size(); ++i)
+        {
+            count += std::popcount(node.bytes[i]);
+            if (node.bytes[i])
+                byte = static_cast<char>(i * 64 + std::countr_zero(node.bytes[i]));
+        }
+        return count == 1;
+    }
+
+    static size_t min_length_of(const Node &node)
+    {
+        size_t length = 0;
+        switch (node.kind)
+        {
+        case Node::Kind::Bytes:
+            return 1;
+        case Node::Kind::Assert:
+            return 0;
+        case Node::Kind::Group:
+            return min_length_of(*node.children.front());
+        case Node::Kind::Repeat:
+            return node.min * min_length_of(*node.children.front());
+        case Node::Kind::Concat:
+            for (const auto &child : node.children)
+                length += min_length_of(*child);
+            return length;
+        case Node::Kind::Alternate:
+            length = static_cast<size_t>(-1);
+            for (const auto &child : node.children)
+                length = std::min(length, min_length_of(*child));
+            return length;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Longest literal run that every match of `node` contains. Zero-width assertions do not break a run.
+     */
+    static std::string required_literal(const Node &node)
+    {
+        switch (node.kind)
+        {
+        case Node::Kind::Bytes: {
+            char byte = 0;
+            return single_byte(node, byte) ? std::string(1, byte) : std::string();
+        }
+        case Node::Kind::Group:
+            return required_literal(*node.children.front());
+        case Node::Kind::Repeat:
+            return node.min > 0 ? required_literal(*node.children.front()) : std::string();
+        case Node::Kind::Concat: {
+            std::string best, run;
+            for (const auto &child : node.children)
+            {
+                char byte = 0;
+                if (single_byte(*child, byte))
+                {
+                    run += byte;
+                    continue;
+                }
+                if (child->kind == Node::Kind::Assert)
+                    continue;
+                if (run.size() > best.size())
+                    best = run;
+                run.clear();
+                std::string inner = required_literal(*child);
+                if (inner.size() > best.size())
+                    best = std::move(inner);
+            }
+            return run.size() > best.size() ? run : best;
+        }
+        case Node::Kind::Alternate:
+        case Node::Kind::Assert:
+            break;
+        }
+        return {};
+    }
+
+    static bool starts_anchored(const Node &node)
+    {
+        switch (node.kind)
+        {
+        case Node::Kind::Assert:
+            return node.assertion == AssertKind::LineStart;
+        case Node::Kind::Group:
+            return starts_anchored(*node.children.front());
+        case Node::Kind::Concat:
+            return !node.children.empty() && starts_anchored(*node.children.front());
+        case Node::Kind::Alternate:
+            return std::all_of(node.children.begin(), node.children.end(),
+                               [](const auto &child) { return starts_anchored(*child); });
+        default:
+            return false;
+        }
+    }
+
+    /**
+     * @brief Appends the literal bytes every match starts with; returns false once the prefix ends.
+     */
+    static bool collect_prefix(const Node &node, std::string &prefix)
+    {
+        char byte = 0;
+        switch (node.kind)
+        {
+        case Node::Kind::Assert:
+            return true;
+        case Node::Kind::Bytes:
+            if (!single_byte(node, byte))
+                return false;
+            prefix += byte;
+            return true;
+        case Node::Kind::Group:
+            return collect_prefix(*node.children.front(), prefix);
+        case Node::Kind::Concat:
+            for (const auto &child : node.children)
+            {
+                if (!collect_prefix(*child, prefix))
+                    return false;
+            }
+            return true;
+        default:
+            return false;
+        }
+    }
+};
+
+class Compiler
+{
+    Program &program_;
+
+  public:
+    explicit Compiler(Program &program) : program_(program)
+    {
+    }
+
+    void compile(const Node &root, int capture_count)
+    {
+        program_.capture_slots = 2 * (capture_count + 1);
+        emit(Inst::Op::Save, 0);
+        emit_node(root);
+        emit(Inst::Op::Save, 1);
+        emit(Inst::Op::Match);
+    }
+
+  private:
+    size_t emit(Inst::Op op, uint32_t x = 0, uint32_t y = 0)
+    {
+        if (program_.insts.size() >= kMaxInstructions)
+            throw RegexError("pattern too large");
+        program_.insts.push_back(Inst{op, x, y});
+        return program_.insts.size() - 1;
+    }
+
+    uint32_t here() const
+    {
+        return static_cast<uint32_t>(program_.insts.size());
+    }
+
+    void emit_node(const Node &node)
+    {
+        switch (node.kind)
+        {
+        case Node::Kind::Bytes:
+            program_.sets.push_back(node.bytes);
+            emit(Inst::Op::Bytes, static_cast<uint32_t>(program_.sets.size() - 1));
+            break;
+        case Node::Kind::Concat:
+            for (const auto &child : node.children)
+                emit_node(*child);
+            break;
+        case Node::Kind::Alternate: {
+            std::vector<size_t> exits;
+            for (size_t i = 0; i + 1 < node.children.size(); ++i)
+            {
+                size_t split = emit(Inst::Op::Split);
+                program_.insts[split].x = here();
+                emit_node(*node.children[i]);
+                exits.push_back(emit(Inst::Op::Jmp));
+                program_.insts[split].y = here();
+            }
+            emit_node(*node.children.back());
+            for (size_t jump : exits)
+                program_.insts[jump].x = here();
+            break;
+        }
+        case Node::Kind::Group:
+            emit(Inst::Op::Save, 2 * node.capture);
+            emit_node(*node.children.front());
+            emit(Inst::Op::Save, 2 * node.capture + 1);
+            break;
+        case Node::Kind::Assert:
+            emit(Inst::Op::Assert, static_cast<uint32_t>(node.assertion));
+            break;
+        case Node::Kind::Repeat:
+            emit_repeat(node);
+            break;
+        }
+    }
+
+    void emit_repeat(const Node &node)
+    {
+        const Node &body = *node.children.front();
+        for (int i = 0; i < node.min; ++i)
+            emit_node(body);
+
+        if (node.max < 0)
+        {
+            // loop: split body, exit; body; jmp loop
+            size_t split = emit(Inst::Op::Split);
+            emit_node(body);
+            emit(Inst::Op::Jmp, static_cast<uint32_t>(split));
+            set_branches(split, static_cast<uint32_t>(split + 1), here(), node.greedy);
+            return;
+        }
+
+        // (body(body(...)?)?)? for the optional tail, every split exiting to the end
+        std::vector<size_t> splits;
+        for (int i = node.min; i < node.max; ++i)
+        {
+            splits.push_back(emit(Inst::Op::Split));
+            emit_node(body);
+        }
+        for (size_t split : splits)
+            set_branches(split, static_cast<uint32_t>(split + 1), here(), node.greedy);
+    }
+
+    void set_branches(size_t split, uint32_t body, uint32_t exit, bool greedy)
+    {
+        program_.insts[split].x = greedy ? body : exit;
+        program_.insts[split].y = greedy ? exit : body;
+    }
+};
+
+// --- NFA Execution ---
+
+/**
+ * @brief Executes the compiled NFA with one of two engines that both visit each (instruction, position) pair at
+ * most once, so matching is linear in the subject length and never goes exponential:
+ * - a bounded backtracker with a visited bitmap, cheapest for the short values typical of a column;
+ * - a Pike VM that runs all threads in lock step, used when the bitmap would grow too large.
+ * Both explore alternatives in priority order, so captures equal the leftmost-first (ECMAScript) answer.
+ */
+class NfaBackend final : public RegexBackend
+{
+    struct ThreadList
+    {
+        std::vector<uint32_t> pcs;
+        std::vector<size_t> captures;
+        std::vector<uint32_t> marks;
+        uint32_t generation = 0;
+
+        void reset(size_t program_size)
+        {
+            pcs.clear();
+            captures.clear();
+            if (marks.size() < program_size)
+                marks.resize(program_size, 0);
+            if (++generation == 0)
+            {
+                std::fill(marks.begin(), marks.end(), 0);
+                generation = 1;
+            }
+        }
+
+        bool mark(uint32_t pc)
+        {
+            if (marks[pc] == generation)
+                return false;
+            marks[pc] = generation;
+            return true;
+        }
+    };
+
+    struct Frame
+    {
+        uint32_t pc;
+        size_t pos;
+        size_t restore_slot;
+        size_t restore_value;
+    };
+
+    static constexpr size_t kNoRestore = static_cast<size_t>(-1);
+
+    struct Scratch
+    {
+        ThreadList lists[2];
+        std::vector<Frame> stack;
+        std::vector<size_t> captures;
+        std::vector<size_t> best;
+        std::vector<uint64_t> visited;
+    };
+
+    enum class Anchor
+    {
+        None,          // leftmost match anywhere at or after start
+        Both,          // the whole subject
+        StartNonEmpty  // a non-empty match beginning at start
+    };
+
+    Program program_;
+    Prefilter prefilter_;
+    size_t groups_;
+
+  public:
+    explicit NfaBackend(const std::string &pattern)
+    {
+        Parser parser(pattern);
+        auto root = parser.parse();
+        groups_ = static_cast<size_t>(parser.capture_count());
+        prefilter_ = Prefilter::analyze(*root);
+        Compiler(program_).compile(*root, parser.capture_count());
+    }
+
+    bool match(std::string_view subject, RegexMatch *match) const override
+    {
+        return prefilter_.may_match(subject, 0, true) && run(subject, 0, Anchor::Both, match);
+    }
+
+    bool search(std::string_view subject, size_t start, RegexMatch *match) const override
+    {
+        return prefilter_.may_match(subject, start, false) && run(subject, start, Anchor::None, match);
+    }
+
+    bool match_non_empty_at(std::string_view subject, size_t start, RegexMatch *match) const override
+    {
+        return prefilter_.may_match(subject, start, false) && run(subject, start, Anchor::StartNonEmpty, match);
+    }
+
+    size_t group_count() const override
+    {
+        return groups_;
+    }
+
+    bool linear_time() const override
+    {
+        return true;
+    }
+
+  private:
+    static bool assertion_holds(AssertKind kind, std::string_view subject, size_t pos)
+    {
+        switch (kind)
+        {
+        case AssertKind::LineStart:
+            return pos == 0;
+        case AssertKind::LineEnd:
+            return pos == subject.size();
+        case AssertKind::WordBoundary:
+        case AssertKind::NotWordBoundary: {
+            bool before = pos > 0 && is_word_byte(static_cast<unsigned char>(subject[pos - 1]));
+            bool after = pos < subject.size() && is_word_byte(static_cast<unsigned char>(subject[pos]));
+            return (before != after) == (kind == AssertKind::WordBoundary);
+        }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Follows the epsilon closure of `pc` at `pos`, appending the byte-consuming and matching threads to
+     * `list` in priority order. `captures` is restored to its original contents on return.
+     */
+    void add_thread(Scratch &scratch, ThreadList &list, uint32_t pc, size_t pos, std::string_view subject,
+                    size_t slots) const
+    {
+        auto &stack = scratch.stack;
+        auto &captures = scratch.captures;
+        stack.push_back(Frame{pc, pos, kNoRestore, 0});
+
+        while (!stack.empty())
+        {
+            Frame frame = stack.back();
+            stack.pop_back();
+            if (frame.restore_slot != kNoRestore)
+            {
+                captures[frame.restore_slot] = frame.restore_value;
+                continue;
+            }
+            if (!list.mark(frame.pc))
+                continue;
+
+            const Inst &inst = program_.insts[frame.pc];
+            switch (inst.op)
+            {
+            case Inst::Op::Jmp:
+                stack.push_back(Frame{inst.x, pos, kNoRestore, 0});
+                break;
+            case Inst::Op::Split:
+                stack.push_back(Frame{inst.y, pos, kNoRestore, 0});
+                stack.push_back(Frame{inst.x, pos, kNoRestore, 0});
+                break;
+            case Inst::Op::Save:
+                if (inst.x < slots)
+                {
+                    stack.push_back(Frame{0, 0, inst.x, captures[inst.x]});
+                    captures[inst.x] = pos;
+                }
+                stack.push_back(Frame{frame.pc + 1, pos, kNoRestore, 0});
+                break;
+            case Inst::Op::Assert:
+                if (assertion_holds(static_cast<AssertKind>(inst.x), subject, pos))
+                    stack.push_back(Frame{frame.pc + 1, pos, kNoRestore, 0});
+                break;
+            case Inst::Op::Bytes:
+            case Inst::Op::Match:
+                list.pcs.push_back(frame.pc);
+                list.captures.insert(list.captures.end(), captures.begin(), captures.begin() + slots);
+                break;
+            }
+        }
+    }
+
+    static bool accepts(Anchor anchor, size_t start, size_t pos, size_t size)
+    {
+        return (anchor != Anchor::Both || pos == size) && (anchor != Anchor::StartNonEmpty || pos != start);
+    }
+
+    bool run(std::string_view subject, size_t start, Anchor anchor, RegexMatch *match) const
+    {
+        // Execution scratch is per thread so a compiled program stays immutable and shareable.
+        thread_local Scratch scratch;
+
+        if (program_.insts.size() * (subject.size() - start + 1) <= kMaxBacktrackBits)
+            return run_backtrack(scratch, subject, start, anchor, match);
+        return run_pike(scratch, subject, start, anchor, match);
+    }
+
+    bool run_backtrack(Scratch &scratch, std::string_view subject, size_t start, Anchor anchor,
+                       RegexMatch *match) const
+    {
+        const size_t slots = match ? program_.capture_slots : 0;
+        const size_t width = subject.size() - start + 1;
+        auto &visited = scratch.visited;
+        auto &stack = scratch.stack;
+        auto &captures = scratch.captures;
+        visited.assign((program_.insts.size() * width + 63) / 64, 0);
+
+        // A (pc, pos) pair that failed once fails from every later start too, so visited is shared across starts.
+        const size_t last_start = anchor == Anchor::None && !prefilter_.anchored_start ? subject.size() : start;
+        for (size_t first = start; first <= last_start; ++first)
+        {
+            captures.assign(slots, RegexMatch::npos);
+            stack.clear();
+            stack.push_back(Frame{0, first, kNoRestore, 0});
+
+            while (!stack.empty())
+            {
+                Frame frame = stack.back();
+                stack.pop_back();
+                if (frame.restore_slot != kNoRestore)
+                {
+                    captures[frame.restore_slot] = frame.restore_value;
+                    continue;
+                }
+
+                // Follow the highest-priority path, leaving alternatives on the stack.
+                uint32_t pc = frame.pc;
+                size_t pos = frame.pos;
+                for (;;)
+                {
+                    const size_t bit = pc * width + (pos - start);
+                    if ((visited[bit >> 6] >> (bit & 63)) & 1)
+                        break;
+                    visited[bit >> 6] |= uint64_t(1) << (bit & 63);
+
+                    const Inst &inst = program_.insts[pc];
+                    switch (inst.op)
+                    {
+                    case Inst::Op::Bytes:
+                        if (pos < subject.size() &&
+                            has_byte(program_.sets[inst.x], static_cast<unsigned char>(subject[pos])))
+                        {
+                            ++pc, ++pos;
+                            continue;
+                        }
+                        break;
+                    case Inst::Op::Split:
+                        stack.push_back(Frame{inst.y, pos, kNoRestore, 0});
+                        pc = inst.x;
+                        continue;
+                    case Inst::Op::Jmp:
+                        pc = inst.x;
+                        continue;
+                    case Inst::Op::Save:
+                        if (inst.x < slots)
+                        {
+                            stack.push_back(Frame{0, 0, inst.x, captures[inst.x]});
+                            captures[inst.x] = pos;
+                        }
+                        ++pc;
+                        continue;
+                    case Inst::Op::Assert:
+                        if (assertion_holds(static_cast<AssertKind>(inst.x), subject, pos))
+                        {
+                            ++pc;
+                            continue;
+                        }
+                        break;
+                    case Inst::Op::Match:
+                        if (accepts(anchor, start, pos, subject.size()))
+                        {
+                            if (match)
+                            {
+                                match->subject = subject;
+                                match->offsets.assign(captures.begin(), captures.begin() + slots);
+                            }
+                            return true;
+                        }
+                        break;
+                    }
+                    break;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool run_pike(Scratch &scratch, std::string_view subject, size_t start, Anchor anchor, RegexMatch *match) const
+    {
+        const bool anchored = anchor != Anchor::None || prefilter_.anchored_start;
+
+        const size_t slots = match ? program_.capture_slots : 0;
+        const size_t program_size = program_.insts.size();
+        ThreadList *current = &scratch.lists[0];
+        ThreadList *next = &scratch.lists[1];
+        current->reset(program_size);
+        scratch.captures.assign(slots, RegexMatch::npos);
+
+        bool matched = false;
+        for (size_t pos = start;; ++pos)
+        {
+            // Seed a new, lowest-priority thread at every position until something matches (search mode).
+            if (!matched && (pos == start || !anchored))
+            {
+                std::fill(scratch.captures.begin(), scratch.captures.end(), RegexMatch::npos);
+                add_thread(scratch, *current, 0, pos, subject, slots);
+            }
+            if (current->pcs.empty() && (matched || anchored))
+                break;
+
+            next->reset(program_size);
+            for (size_t i = 0; i < current->pcs.size(); ++i)
+            {
+                const uint32_t pc = current->pcs[i];
+                const Inst &inst = program_.insts[pc];
+                const size_t *thread_captures = current->captures.data() + i * slots;
+
+                if (inst.op == Inst::Op::Bytes)
+                {
+                    if (pos < subject.size() &&
+                        has_byte(program_.sets[inst.x], static_cast<unsigned char>(subject[pos])))
+                    {
+                        std::copy(thread_captures, thread_captures + slots, scratch.captures.begin());
+                        add_thread(scratch, *next, pc + 1, pos + 1, subject, slots);
+                    }
+                }
+                else if (accepts(anchor, start, pos, subject.size()))
+                {
+                    // Match: lower-priority threads can no longer win.
+                    matched = true;
+                    scratch.best.assign(thread_captures, thread_captures + slots);
+                    break;
+                }
+            }
+            std::swap(current, next);
+
+            if (pos >= subject.size())
+                break;
+        }
+
+        if (matched && match)
+        {
+            match->subject = subject;
+            match->offsets = scratch.best;
+        }
+        return matched;
+    }
+};
+
+// --- std::regex Fallback ---
+
+class StdRegexBackend final : public RegexBackend
+{
+    std::regex regex_;
+
+  public:
+    explicit StdRegexBackend(const std::string &pattern)
+    {
+        try
+        {
+            regex_.assign(pattern);
+        }
+        catch (const std::regex_error &e)
+        {
+            throw RegexError(e.what());
+        }
+    }
+
+    bool match(std::string_view subject, RegexMatch *match) const override
+    {
+        std::cmatch results;
+        const char *begin = subject.data() ? subject.data() : "";
+        if (!std::regex_match(begin, begin + subject.size(), results, regex_))
+            return false;
+        fill(results, begin, subject, match);
+        return true;
+    }
+
+    bool search(std::string_view subject, size_t start, RegexMatch *match) const override
+    {
+        return search(subject, start, match, std::regex_constants::match_default);
+    }
+
+    bool match_non_empty_at(std::string_view subject, size_t start, RegexMatch *match) const override
+    {
+        return search(subject, start, match,
+                      std::regex_constants::match_not_null | std::regex_constants::match_continuous);
+    }
+
+    size_t group_count() const override
+    {
+        return regex_.mark_count();
+    }
+
+    bool linear_time() const override
+    {
+        return false;
+    }
+
+  private:
+    bool search(std::string_view subject, size_t start, RegexMatch *match,
+                std::regex_constants::match_flag_type flags) const
+    {
+        std::cmatch results;
+        const char *begin = subject.data() ? subject.data() : "";
+        if (start > 0)
+            flags |= std::regex_constants::match_prev_avail;
+        if (!std::regex_search(begin + start, begin + subject.size(), results, regex_, flags))
+            return false;
+        fill(results, begin, subject, match);
+        return true;
+    }
+
+    static void fill(const std::cmatch &results, const char *begin, std::string_view subject, RegexMatch *match)
+    {
+        if (!match)
+            return;
+        match->subject = subject;
+        match->offsets.assign(2 * results.size(), RegexMatch::npos);
+        for (size_t group = 0; group < results.size(); ++group)
+        {
+            if (!results[group].matched)
+                continue;
+            match->offsets[2 * group] = results[group].first - begin;
+            match->offsets[2 * group + 1] = results[group].second - begin;
+        }
+    }
+};
+
+} // namespace
+
+Regex::Regex(const std::string &pattern, Engine engine) : pattern_(pattern)
+{
+    if (engine != Engine::Std)
+    {
+        try
+        {
+            backend_ = std::make_shared<NfaBackend>(pattern);
+            return;
+        }
+        catch (const UnsupportedSyntax &e)
+        {
+            if (engine == Engine::Nfa)
+                throw RegexError(std::string("unsupported by the linear-time engine: ") + e.what());
+            std::cerr << "Warning: Pattern " << pattern << " uses " << e.what()
+                      << ", which the linear-time engine does not support; falling back to std::regex\n";
+        }
+    }
+    backend_ = std::make_shared<StdRegexBackend>(pattern);
+}
+
+std::string Regex::replace(std::string_view subject, std::string_view format) const
+{
+    std::string out;
+    replace(out, subject, RegexFormat(format));
+    return out;
+}
+
+void Regex::replace(std::string &out, std::string_view subject, const RegexFormat &format,
+                    std::span<const std::string> dynamic) const
+{
+    RegexMatch match;
+    size_t last = 0;
+
+    bool found = search(subject, 0, match);
+    while (found)
+    {
+        out.append(subject.substr(last, match.begin(0) - last));
+        format.append(out, match, last, dynamic);
+        last = match.end(0);
+
+        if (match.begin(0) != match.end(0))
+        {
+            found = search(subject, last, match);
+        }
+        else
+        {
+            // Like std::regex_iterator: after an empty match, prefer a non-empty one at the same position,
+            // otherwise step over one byte (copied later as prefix).
+            found = backend_->match_non_empty_at(subject, last, &match) ||
+                    (last < subject.size() && search(subject, last + 1, match));
+        }
+    }
+    out.append(subject.substr(last));
+}
+
+// --- Replacement Formats ---
+
+void RegexFormat::add_literal(std::string_view text)
+{
+    if (!segments_.empty() && segments_.back().kind == Segment::Kind::Literal)
+        segments_.back().text.append(text);
+    else
+        segments_.push_back(Segment{Segment::Kind::Literal, std::string(text), 0});
+}
+
+void RegexFormat::add_format(std::string_view format)
+{
+    dangling_ = false;
+    for (size_t i = 0; i < format.size(); ++i)
+    {
+        char c = format[i];
+        if (c != '$' || i + 1 == format.size())
+        {
+            add_literal(format.substr(i, 1));
+            dangling_ = c == '$';
+            continue;
+        }
+
+        char next = format[i + 1];
+        if (next == '$')
+        {
+            add_literal("$");
+            ++i;
+        }
+        else if (next == '&')
+        {
+            segments_.push_back(Segment{Segment::Kind::Group, {}, 0});
+            ++i;
+        }
+        else if (next == '`')
+        {
+            segments_.push_back(Segment{Segment::Kind::Prefix, {}, 0});
+            ++i;
+        }
+        else if (next == '\'')
+        {
+            segments_.push_back(Segment{Segment::Kind::Suffix, {}, 0});
+            ++i;
+        }
+        else if (std::isdigit(static_cast<unsigned char>(next)))
+        {
+            size_t group = next - '0';
+            ++i;
+            if (i + 1 < format.size() && std::isdigit(static_cast<unsigned char>(format[i + 1])))
+                group = group * 10 + (format[++i] - '0');
+            segments_.push_back(Segment{Segment::Kind::Group, {}, group});
+        }
+        else
+        {
+            add_literal("$");
+        }
+    }
+}
+
+void RegexFormat::add_dynamic()
+{
+    segments_.push_back(Segment{Segment::Kind::Dynamic, {}, dynamic_count_++});
+    dangling_ = false;
+}
+
+void RegexFormat::append(std::string &out, const RegexMatch &match, size_t prefix_begin,
+                         std::span<const std::string> dynamic) const
+{
+    for (const Segment &segment : segments_)
+    {
+        switch (segment.kind)
+        {
+        case Segment::Kind::Literal:
+            out.append(segment.text);
+            break;
+        case Segment::Kind::Group:
+            out.append(match.group(segment.index));
+            break;
+        case Segment::Kind::Prefix:
+            out.append(match.subject.substr(prefix_begin, match.begin(0) - prefix_begin));
+            break;
+        case Segment::Kind::Suffix:
+            out.append(match.subject.substr(match.end(0)));
+            break;
+        case Segment::Kind::Dynamic:
+            out.append(dynamic[segment.index]);
+            break;
+        }
+    }
+}
+
+// --- Regex Sets ---
+
+namespace
+{
+
+// Subset construction stops here; larger sets are simulated state set by state set instead.
+constexpr size_t kMaxDfaStates = 2048;
+
+/**
+ * @brief Compiles one member of a set. Its Match instruction carries the member's index instead of a capture count.
+ */
+Program compile_set_member(const std::string &pattern, uint32_t index)
+{
+    Parser parser(pattern);
+    auto root = parser.parse();
+    Program program;
+    Compiler(program).compile(*root, parser.capture_count());
+    for (auto &inst : program.insts)
+    {
+        if (inst.op == Inst::Op::Assert && (static_cast<AssertKind>(inst.x) == AssertKind::WordBoundary ||
+                                            static_cast<AssertKind>(inst.x) == AssertKind::NotWordBoundary))
+            throw UnsupportedSyntax("word boundaries");
+        if (inst.op == Inst::Op::Match)
+            inst.x = index;
+    }
+    return program;
+}
+
+} // namespace
+
+/**
+ * @brief The members' programs joined into one NFA, determinized up front over byte equivalence classes.
+ * A DFA state is the sorted set of instructions alive at a position: byte tests, Match instructions and `$`
+ * assertions left pending until the end of the subject is known. Being built eagerly, it never changes afterwards.
+ */
+struct RegexSet::Automaton
+{
+    static constexpr uint32_t kDead = 0;
+
+    Program program;
+    std::vector<uint32_t> starts;
+    size_t words = 0;
+
+    std::array<uint8_t, 256> byte_class{};
+    std::vector<unsigned char> representatives; // one byte of each class
+    std::vector<uint32_t> start_state;          // closure of `starts` at position 0
+    std::vector<uint64_t> empty_accept;         // members matching the empty subject
+
+    bool has_dfa = false;
+    uint32_t start = kDead;
+    std::vector<uint32_t> transitions; // [state * classes + class]
+    std::vector<uint64_t> accepts;     // [state * words], members matching when the subject ends in state
+
+    /**
+     * @brief Follows empty transitions from `seeds`. `$` holds only `at_end`; before that it stays in the set.
+     */
+    void closure(const std::vector<uint32_t> &seeds, bool at_start, bool at_end, std::vector<uint32_t> &out) const
+    {
+        std::vector<bool> seen(program.insts.size());
+        std::vector<uint32_t> stack(seeds.rbegin(), seeds.rend());
+        out.clear();
+        while (!stack.empty())
+        {
+            const uint32_t pc = stack.back();
+            stack.pop_back();
+            if (seen[pc])
+                continue;
+            seen[pc] = true;
+
+            const Inst &inst = program.insts[pc];
+            switch (inst.op)
+            {
+            case Inst::Op::Bytes:
+            case Inst::Op::Match:
+                out.push_back(pc);
+                break;
+            case Inst::Op::Jmp:
+                stack.push_back(inst.x);
+                break;
+            case Inst::Op::Split:
+                stack.push_back(inst.y);
+                stack.push_back(inst.x);
+                break;
+            case Inst::Op::Save:
+                stack.push_back(pc + 1);
+                break;
+            case Inst::Op::Assert:
+                if (static_cast<AssertKind>(inst.x) == AssertKind::LineStart)
+                {
+                    if (at_start)
+                        stack.push_back(pc + 1);
+                }
+                else if (at_end)
+                {
+                    stack.push_back(pc + 1);
+                }
+                else
+                {
+                    out.push_back(pc);
+                }
+                break;
+            }
+        }
+        std::sort(out.begin(), out.end());
+    }
+
+    void step(const std::vector<uint32_t> &state, unsigned char byte, std::vector<uint32_t> &out) const
+    {
+        std::vector<uint32_t> seeds;
+        for (uint32_t pc : state)
+        {
+            const Inst &inst = program.insts[pc];
+            if (inst.op == Inst::Op::Bytes && has_byte(program.sets[inst.x], byte))
+                seeds.push_back(pc + 1);
+        }
+        closure(seeds, false, false, out);
+    }
+
+    void accept(const std::vector<uint32_t> &state, bool at_start, uint64_t *bits) const
+    {
+        std::vector<uint32_t> final_state;
+        closure(state, at_start, true, final_state);
+        for (uint32_t pc : final_state)
+        {
+            const Inst &inst = program.insts[pc];
+            if (inst.op == Inst::Op::Match)
+                bits[inst.x >> 6] |= uint64_t(1) << (inst.x & 63);
+        }
+    }
+
+    void build_byte_classes()
+    {
+        std::map<std::vector<bool>, uint8_t> classes;
+        for (unsigned c = 0; c < 256; ++c)
+        {
+            std::vector<bool> signature(program.sets.size());
+            for (size_t i = 0; i < program.sets.size(); ++i)
+                signature[i] = has_byte(program.sets[i], static_cast<unsigned char>(c));
+
+            auto [it, inserted] = classes.emplace(std::move(signature), static_cast<uint8_t>(classes.size()));
+            if (inserted)
+                representatives.push_back(static_cast<unsigned char>(c));
+            byte_class[c] = it->second;
+        }
+    }
+
+    void build_dfa()
+    {
+        std::map<std::vector<uint32_t>, uint32_t> ids;
+        std::vector<std::vector<uint32_t>> states;
+        auto intern = [&](const std::vector<uint32_t> &state) {
+            auto [it, inserted] = ids.emplace(state, static_cast<uint32_t>(states.size()));
+            if (inserted)
+                states.push_back(state);
+            return it->second;
+        };
+
+        intern({}); // kDead
+        start = intern(start_state);
+
+        const size_t classes = representatives.size();
+        std::vector<uint32_t> next;
+        for (size_t s = 0; s < states.size(); ++s)
+        {
+            const std::vector<uint32_t> state = states[s];
+            for (size_t c = 0; c < classes; ++c)
+            {
+                step(state, representatives[c], next);
+                transitions.push_back(intern(next));
+            }
+            if (states.size() > kMaxDfaStates)
+            {
+                transitions.clear();
+                return;
+            }
+        }
+
+        accepts.assign(states.size() * words, 0);
+        for (size_t s = 0; s < states.size(); ++s)
+            accept(states[s], false, accepts.data() + s * words);
+        has_dfa = true;
+    }
+};
+
+bool RegexSet::supports(const std::string &pattern)
+{
+    try
+    {
+        compile_set_member(pattern, 0);
+        return true;
+    }
+    catch (const RegexError &)
+    {
+        return false;
+    }
+}
+
+RegexSet::RegexSet(const std::vector<std::string> &patterns) : size_(patterns.size())
+{
+    auto automaton = std::make_shared<Automaton>();
+    Program &combined = automaton->program;
+
+    for (size_t index = 0; index < patterns.size(); ++index)
+    {
+        Program member = compile_set_member(patterns[index], static_cast<uint32_t>(index));
+        const auto offset = static_cast<uint32_t>(combined.insts.size());
+        const auto set_offset = static_cast<uint32_t>(combined.sets.size());
+        if (offset + member.insts.size() > kMaxInstructions)
+            throw RegexError("pattern set too large");
+
+        for (Inst inst : member.insts)
+        {
+            if (inst.op == Inst::Op::Bytes)
+                inst.x += set_offset;
+            else if (inst.op == Inst::Op::Jmp)
+                inst.x += offset;
+            else if (inst.op == Inst::Op::Split)
+                inst.x += offset, inst.y += offset;
+            combined.insts.push_back(inst);
+        }
+        combined.sets.insert(combined.sets.end(), member.sets.begin(), member.sets.end());
+        automaton->starts.push_back(offset);
+    }
+
+    automaton->words = (size_ + 63) / 64;
+    automaton->closure(automaton->starts, true, false, automaton->start_state);
+    automaton->empty_accept.assign(automaton->words, 0);
+    automaton->accept(automaton->starts, true, automaton->empty_accept.data());
+    automaton->build_byte_classes();
+    automaton->build_dfa();
+    automaton_ = std::move(automaton);
+}
+
+void RegexSet::match(std::string_view subject, std::vector<uint64_t> &matched) const
+{
+    const Automaton &automaton = *automaton_;
+    if (subject.empty())
+    {
+        matched = automaton.empty_accept;
+        return;
+    }
+
+    matched.assign(automaton.words, 0);
+    if (automaton.has_dfa)
+    {
+        const size_t classes = automaton.representatives.size();
+        uint32_t state = automaton.start;
+        for (char c : subject)
+        {
+            state = automaton.transitions[state * classes + automaton.byte_class[static_cast<unsigned char>(c)]];
+            if (state == Automaton::kDead)
+                return;
+        }
+        std::copy_n(automaton.accepts.begin() + state * automaton.words, automaton.words, matched.begin());
+        return;
+    }
+
+    std::vector<uint32_t> current = automaton.start_state, next;
+    for (char c : subject)
+    {
+        automaton.step(current, static_cast<unsigned char>(c), next);
+        std::swap(current, next);
+        if (current.empty())
+            return;
+    }
+    automaton.accept(current, false, matched.data());
+}
@@ -0,0 +1,68 @@
+#include "pg_anonymous/RowExecutor.hpp"
+
+RowExecutor::RowExecutor() : find_tabs_(active_kernels().find_tabs)
+{
+}
+
+void RowExecutor::begin(const RowSlots &slots, const std::vector<size_t> &slot_indices,
+                        const std::vector<const IRule *> &column_rules, ExecutionContext &execution)
+{
+    slots_ = &slots;
+    slot_indices_ = &slot_indices;
+    column_rules_ = &column_rules;
+    execution_ = &execution;
+}
+
+void RowExecutor::transform(std::string_view line, uint64_t ordinal, std::string &out)
+{
+    // 1. Split the raw line into views over the ORIGINAL data; rules never mutate it.
+    // Tabs are located a bounded batch at a time; a full batch means the scan resumes after it.
+    row_values_.clear();
+    size_t start = 0;
+    for (size_t found = kTabBatch; found == kTabBatch;)
+    {
+        found = find_tabs_(line.data() + start, line.size() - start, tab_offsets_, kTabBatch);
+        const size_t base = start;
+        for (size_t k = 0; k < found; ++k)
+        {
+            row_values_.push_back(line.substr(start, base + tab_offsets_[k] - start));
+            start = base + tab_offsets_[k] + 1;
+        }
+    }
+    row_values_.push_back(line.substr(start));
+
+    // 2. Create Context: ONLY use the ORIGINAL data to meet the requirement.
+    // Shared match slots are computed at most once for this row.
+    cache_.next_row();
+    const RowContext ctx{*slots_, *slot_indices_, row_values_, cache_, *execution_, ordinal};
+
+    // 3. Iterate and apply rules
+    const std::vector<const IRule *> &column_rules = *column_rules_;
+    for (size_t i = 0; i < row_values_.size(); ++i)
+    {
+        if (i > 0)
+            out += '\t';
+
+        const IRule *rule = i < column_rules.size() ? column_rules[i] : nullptr;
+        if (rule)
+        {
+            // APPLY THE RULE
+            // Column-reading rules (MATCH_GROUP, MATCHES) use ctx.get_column_value()
+            // with the slots bound above to retrieve ORIGINAL data.
+            try
+            {
+                out += rule->apply(std::string(row_values_[i]), ctx);
+            }
+            catch (const std::exception &e)
+            {
+                throw RowError(i, ordinal, e.what());
+            }
+        }
+        else
+        {
+            // Output the untransformed value
+            out += row_values_[i];
+        }
+    }
+    out += '\n';
+}